@@ -0,0 +1,130 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <BulletCollision/BroadphaseCollision/btDbvt.h>
+
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+#include "mesh.hpp"
+#include "culling.hpp"
+
+CullingStats cullingStats = { 0, 0, 0, 0.0 };
+
+void extractFrustum(const glm::mat4 & ViewProjectionMatrix, Frustum & frustum){
+	// The rows of the matrix : a clip space point is inside when -w <= x, y, z <= w
+	glm::vec4 rows[4];
+	for ( int i=0; i<4; i++ )
+		rows[i] = glm::vec4(ViewProjectionMatrix[0][i], ViewProjectionMatrix[1][i], ViewProjectionMatrix[2][i], ViewProjectionMatrix[3][i]);
+	for ( int i=0; i<3; i++ ){
+		frustum.planes[2 * i]     = rows[3] + rows[i];
+		frustum.planes[2 * i + 1] = rows[3] - rows[i];
+	}
+	// Normalized, so that the sphere tests compare distances
+	for ( int i=0; i<6; i++ ){
+		float length = glm::length(glm::vec3(frustum.planes[i]));
+		if ( length > 0.0f )
+			frustum.planes[i] /= length;
+	}
+}
+
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius){
+	for ( int i=0; i<6; i++ )
+		if ( glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius )
+			return false;
+	return true;
+}
+
+// The world space box of a model space box (Arvo, 1990) : the centre moves,
+// the half extents add up along the absolute rotated axes
+static btDbvtVolume worldVolume(const Mesh & mesh, const glm::mat4 & ModelMatrix){
+	glm::vec3 center = glm::vec3(ModelMatrix * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+	glm::vec3 half = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+	glm::vec3 extent(0.0f);
+	for ( int axis=0; axis<3; axis++ )
+		extent += glm::abs(glm::vec3(ModelMatrix[axis])) * half[axis];
+	return btDbvtVolume::FromCE(btVector3(center.x, center.y, center.z), btVector3(extent.x, extent.y, extent.z));
+}
+
+static void placeObject(CullingObject & object, const glm::mat4 & ModelMatrix){
+	object.model = ModelMatrix;
+	object.center = glm::vec3(ModelMatrix * glm::vec4(object.mesh->boundsCenter, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(ModelMatrix[0])),
+		std::max(glm::length(glm::vec3(ModelMatrix[1])), glm::length(glm::vec3(ModelMatrix[2]))));
+	object.radius = object.mesh->boundsRadius * scale;
+}
+
+void createCullingScene(CullingScene & scene){
+	scene.tree = new btDbvt();
+	scene.objects.clear();
+	scene.visible.clear();
+}
+
+void deleteCullingScene(CullingScene & scene){
+	delete scene.tree;
+	scene.tree = NULL;
+	scene.objects.clear();
+	scene.visible.clear();
+}
+
+int addCullingObject(CullingScene & scene, const Mesh & mesh, const glm::mat4 & ModelMatrix){
+	CullingObject object;
+	object.mesh = &mesh;
+	placeObject(object, ModelMatrix);
+	// The leaf keeps the object's index
+	object.leaf = scene.tree->insert(worldVolume(mesh, ModelMatrix), (void*)(size_t)scene.objects.size());
+	scene.objects.push_back(object);
+	scene.visible.push_back(1);
+	return (int)scene.objects.size() - 1;
+}
+
+void moveCullingObject(CullingScene & scene, int index, const glm::mat4 & ModelMatrix){
+	CullingObject & object = scene.objects[index];
+	if ( object.model == ModelMatrix )
+		return;
+	placeObject(object, ModelMatrix);
+	btDbvtVolume volume = worldVolume(*object.mesh, ModelMatrix);
+	scene.tree->update(object.leaf, volume);
+}
+
+// Receives the leaves whose box is not outside a plane
+struct FrustumCollide : btDbvt::ICollide{
+	CullingScene * scene;
+	const Frustum * frustum;
+	void Process(const btDbvtNode * leaf){
+		size_t index = (size_t)leaf->data;
+		const CullingObject & object = scene->objects[index];
+		scene->visible[index] = sphereInFrustum(*frustum, object.center, object.radius) ? 1 : 0;
+	}
+};
+
+void cullScene(CullingScene & scene, const glm::mat4 & ViewProjectionMatrix){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Frustum frustum;
+	extractFrustum(ViewProjectionMatrix, frustum);
+	btVector3 normals[6];
+	btScalar offsets[6];
+	for ( int i=0; i<6; i++ ){
+		normals[i] = btVector3(frustum.planes[i].x, frustum.planes[i].y, frustum.planes[i].z);
+		offsets[i] = frustum.planes[i].w;
+	}
+
+	scene.visible.assign(scene.objects.size(), 0);
+	FrustumCollide collide;
+	collide.scene = &scene;
+	collide.frustum = &frustum;
+	btDbvt::collideKDOP(scene.tree->m_root, normals, offsets, 6, collide);
+
+	unsigned long long visible = 0;
+	for ( size_t i=0; i<scene.visible.size(); i++ )
+		visible += scene.visible[i];
+	cullingStats.queries++;
+	cullingStats.objects += scene.objects.size();
+	cullingStats.culled += scene.objects.size() - visible;
+	cullingStats.cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
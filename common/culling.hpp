@@ -0,0 +1,55 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+// A view frustum : inside each plane where dot(plane.xyz, point) + plane.w >= 0
+struct Frustum{
+	glm::vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// Extracts the planes from ProjectionMatrix * ViewMatrix (Gribb and
+// Hartmann) : the frustum is then in world space.
+void extractFrustum(const glm::mat4 & ViewProjectionMatrix, Frustum & frustum);
+
+// Whether a world space sphere is at least partly inside
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius);
+
+struct btDbvt;     // BulletCollision/BroadphaseCollision/btDbvt.h
+struct btDbvtNode;
+
+// Objects placed by a mesh's bounds and a model matrix, in a bounding volume
+// hierarchy of their world space boxes (Bullet's dynamic AABB tree). A
+// frustum query walks it from the root and drops whole subtrees outside a
+// plane; the objects it reaches are tested with their bounding sphere too.
+struct CullingObject{
+	const Mesh * mesh;
+	glm::mat4 model;
+	glm::vec3 center; // World space bounding sphere
+	float radius;
+	btDbvtNode * leaf;
+};
+struct CullingScene{
+	btDbvt * tree;
+	std::vector<CullingObject> objects;
+	std::vector<char> visible; // Per object, from the last cullScene
+};
+void createCullingScene(CullingScene & scene);
+void deleteCullingScene(CullingScene & scene);
+
+// Adds an object and returns its index
+int addCullingObject(CullingScene & scene, const Mesh & mesh, const glm::mat4 & ModelMatrix);
+// Moves an object; the tree is only updated when the matrix changed
+void moveCullingObject(CullingScene & scene, int object, const glm::mat4 & ModelMatrix);
+
+// Marks the objects in the view of these matrices in scene.visible
+void cullScene(CullingScene & scene, const glm::mat4 & ViewProjectionMatrix);
+
+// What cullScene did since the last reset
+struct CullingStats{
+	unsigned long long queries; // cullScene calls
+	unsigned long long objects;
+	unsigned long long culled;
+	double cullMs;
+};
+extern CullingStats cullingStats;
+
+#endif
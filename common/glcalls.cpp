@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "glcalls.hpp"
+
+static unsigned long long glCallCount = 0;
+
+// Stands in for one GLEW function pointer : counts, then calls the real function.
+template <typename Proc, Proc * Pointer>
+struct CountedGLFunction;
+
+template <typename R, typename... Args, R (GLAPIENTRY ** Pointer)(Args...)>
+struct CountedGLFunction<R (GLAPIENTRY *)(Args...), Pointer>{
+	static R (GLAPIENTRY * original)(Args...);
+
+	static R GLAPIENTRY counted(Args... args){
+		glCallCount++;
+		return original(args...);
+	}
+	static void hook(){
+		if ( original == NULL && *Pointer != NULL ){
+			original = *Pointer;
+			*Pointer = counted;
+		}
+	}
+	static void unhook(){
+		if ( original != NULL ){
+			*Pointer = original;
+			original = NULL;
+		}
+	}
+};
+
+template <typename R, typename... Args, R (GLAPIENTRY ** Pointer)(Args...)>
+R (GLAPIENTRY * CountedGLFunction<R (GLAPIENTRY *)(Args...), Pointer>::original)(Args...) = NULL;
+
+struct GLHook{
+	void (*hook)();
+	void (*unhook)();
+};
+
+#define COUNTED_GL_FUNCTION(name) { CountedGLFunction<decltype(name), &name>::hook, CountedGLFunction<decltype(name), &name>::unhook }
+
+// The functions the renderer calls per frame
+static const GLHook hooks[] = {
+	COUNTED_GL_FUNCTION(__glewActiveTexture),
+	COUNTED_GL_FUNCTION(__glewBindBuffer),
+	COUNTED_GL_FUNCTION(__glewBindBufferBase),
+	COUNTED_GL_FUNCTION(__glewBindBufferRange),
+	COUNTED_GL_FUNCTION(__glewBindVertexArray),
+	COUNTED_GL_FUNCTION(__glewBufferData),
+	COUNTED_GL_FUNCTION(__glewBufferSubData),
+	COUNTED_GL_FUNCTION(__glewDisableVertexAttribArray),
+	COUNTED_GL_FUNCTION(__glewDrawElementsBaseVertex),
+	COUNTED_GL_FUNCTION(__glewEnableVertexAttribArray),
+	COUNTED_GL_FUNCTION(__glewGetAttribLocation),
+	COUNTED_GL_FUNCTION(__glewGetUniformLocation),
+	COUNTED_GL_FUNCTION(__glewMultiDrawElementsIndirect),
+	COUNTED_GL_FUNCTION(__glewUniform1f),
+	COUNTED_GL_FUNCTION(__glewUniform1fv),
+	COUNTED_GL_FUNCTION(__glewUniform1i),
+	COUNTED_GL_FUNCTION(__glewUniform3f),
+	COUNTED_GL_FUNCTION(__glewUniform3fv),
+	COUNTED_GL_FUNCTION(__glewUniform4fv),
+	COUNTED_GL_FUNCTION(__glewUniformMatrix4fv),
+	COUNTED_GL_FUNCTION(__glewUseProgram),
+	COUNTED_GL_FUNCTION(__glewVertexAttribI1i),
+	COUNTED_GL_FUNCTION(__glewVertexAttribPointer),
+};
+
+void startCountingGLCalls(){
+	for ( unsigned int i=0; i<sizeof(hooks)/sizeof(hooks[0]); i++ )
+		hooks[i].hook();
+	glCallCount = 0;
+}
+
+void stopCountingGLCalls(){
+	for ( unsigned int i=0; i<sizeof(hooks)/sizeof(hooks[0]); i++ )
+		hooks[i].unhook();
+}
+
+unsigned long long countedGLCalls(){
+	return glCallCount;
+}
+
+void resetGLCallCount(){
+	glCallCount = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef GLCALLS_HPP
+#define GLCALLS_HPP
+
+// Counts GL calls by swapping GLEW's function pointers for counting ones.
+// Only the entry points listed in glcalls.cpp are seen, and GL 1.0/1.1
+// functions (glDrawElements, glBindTexture, glClear...) never are : they
+// are linked directly, not loaded by GLEW.
+void startCountingGLCalls();
+void stopCountingGLCalls();
+
+// Calls since startCountingGLCalls() or the last reset
+unsigned long long countedGLCalls();
+void resetGLCallCount();
+
+#endif
@@ -0,0 +1,84 @@
+#include <GL/glew.h>
+
+#include "glstate.hpp"
+
+GLStateStats glStateStats = { 0, 0 };
+
+// What is bound, UNKNOWN after resetGLState
+#define UNKNOWN 0xFFFFFFFFu
+static const GLenum textureTargets[3] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER };
+static GLuint program = UNKNOWN;
+static GLuint vertexArray = UNKNOWN;
+static GLuint active = UNKNOWN;
+static GLuint textures[GL_STATE_TEXTURE_UNITS][3];
+static GLuint uniformBuffer = UNKNOWN;
+static GLuint drawIndirectBuffer = UNKNOWN;
+
+void resetGLState(){
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	active = UNKNOWN;
+	for ( int unit=0; unit<GL_STATE_TEXTURE_UNITS; unit++ )
+		for ( int t=0; t<3; t++ )
+			textures[unit][t] = UNKNOWN;
+	uniformBuffer = UNKNOWN;
+	drawIndirectBuffer = UNKNOWN;
+}
+
+// Whether current has to become value; counts the call either way
+static bool change(GLuint & current, GLuint value){
+	if ( current == value ){
+		glStateStats.skipped++;
+		return false;
+	}
+	current = value;
+	glStateStats.calls++;
+	return true;
+}
+
+void useProgram(GLuint value){
+	if ( change(program, value) )
+		glUseProgram(value);
+}
+
+void bindVertexArray(GLuint value){
+	if ( change(vertexArray, value) )
+		glBindVertexArray(value);
+}
+
+void activeTexture(GLuint unit){
+	if ( change(active, unit) )
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+bool bindTexture(GLuint unit, GLenum target, GLuint texture){
+	int t = 0;
+	while ( t < 2 && textureTargets[t] != target )
+		t++;
+	if ( unit >= GL_STATE_TEXTURE_UNITS || textureTargets[t] != target ){
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		active = unit;
+		glStateStats.calls += 2;
+		return true;
+	}
+	if ( textures[unit][t] == texture ){
+		glStateStats.skipped++;
+		return false;
+	}
+	activeTexture(unit);
+	change(textures[unit][t], texture);
+	glBindTexture(target, texture);
+	return true;
+}
+
+void bindBuffer(GLenum target, GLuint buffer){
+	GLuint * current = target == GL_UNIFORM_BUFFER ? &uniformBuffer : target == GL_DRAW_INDIRECT_BUFFER ? &drawIndirectBuffer : NULL;
+	if ( current == NULL ){
+		glBindBuffer(target, buffer);
+		glStateStats.calls++;
+		return;
+	}
+	if ( change(*current, buffer) )
+		glBindBuffer(target, buffer);
+}
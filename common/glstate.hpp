@@ -0,0 +1,31 @@
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+// Texture units the state cache follows
+#define GL_STATE_TEXTURE_UNITS 8
+
+// The GL state the renderer sets, as last set through the functions below :
+// a call that would not change it is skipped. Anything that changes this
+// state with direct GL calls (TwDraw, text2D, the benchmarks) must be
+// followed by resetGLState, which forgets all of it.
+void resetGLState();
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint vertexArray);
+// Makes GL_TEXTURE0 + unit active
+void activeTexture(GLuint unit);
+// On GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_BUFFER of a unit, which
+// it leaves active. Returns whether the texture had to be bound.
+bool bindTexture(GLuint unit, GLenum target, GLuint texture);
+// GL_UNIFORM_BUFFER or GL_DRAW_INDIRECT_BUFFER. The other targets are left
+// to glBindBuffer : the element array buffer is vertex array state.
+void bindBuffer(GLenum target, GLuint buffer);
+
+// The calls made and skipped since the last reset
+struct GLStateStats{
+	unsigned long long calls;
+	unsigned long long skipped;
+};
+extern GLStateStats glStateStats;
+
+#endif
@@ -0,0 +1,40 @@
+#include <atomic>
+
+#include "inputqueue.hpp"
+
+void createInputQueue(InputQueue & queue){
+	queue.head.store(0);
+	queue.tail.store(0);
+	queue.dropped.store(0);
+}
+
+bool pushInputEvent(InputQueue & queue, const InputEvent & event){
+	unsigned int tail = queue.tail.load(std::memory_order_relaxed);
+	if ( tail - queue.head.load(std::memory_order_acquire) >= INPUT_QUEUE_SIZE ){
+		queue.dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	queue.events[tail % INPUT_QUEUE_SIZE] = event;
+	queue.tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool peekInputEvent(InputQueue & queue, InputEvent & event){
+	unsigned int head = queue.head.load(std::memory_order_relaxed);
+	if ( head == queue.tail.load(std::memory_order_acquire) )
+		return false;
+	event = queue.events[head % INPUT_QUEUE_SIZE];
+	return true;
+}
+
+void popInputEvent(InputQueue & queue){
+	unsigned int head = queue.head.load(std::memory_order_relaxed);
+	if ( head != queue.tail.load(std::memory_order_acquire) )
+		queue.head.store(head + 1, std::memory_order_release);
+}
+
+void dropInputEvents(InputQueue & queue, double time){
+	InputEvent event;
+	while ( peekInputEvent(queue, event) && event.time <= time )
+		popInputEvent(queue);
+}
@@ -0,0 +1,42 @@
+#ifndef INPUTQUEUE_HPP
+#define INPUTQUEUE_HPP
+
+// The events the queue holds; one more is dropped until the oldest is popped
+#define INPUT_QUEUE_SIZE 256
+
+// InputEvent::type
+#define INPUT_KEY             0
+#define INPUT_MOUSE_BUTTON    1
+#define INPUT_JOYSTICK_BUTTON 2
+
+// A press or a release, as GLFW reported it
+struct InputEvent{
+	double time; // glfwGetTime() when it came
+	int type;    // INPUT_KEY, INPUT_MOUSE_BUTTON or INPUT_JOYSTICK_BUTTON
+	int code;    // The GLFW key, mouse button, or joystick button
+	int action;  // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	int mods;    // GLFW_MOD_*, 0 for a joystick
+};
+
+// The events in the order they came, in a ring. One thread pushes and one
+// pops, with no lock : each index is only written by one of them, and an
+// event is written before the index that publishes it.
+struct InputQueue{
+	InputEvent events[INPUT_QUEUE_SIZE];
+	std::atomic<unsigned int> head; // The next to pop, the consumer's
+	std::atomic<unsigned int> tail; // The next to push, the producer's
+	std::atomic<unsigned int> dropped; // Pushed while full
+};
+void createInputQueue(InputQueue & queue);
+
+// Adds an event after the others. Returns false, and drops it, when full.
+bool pushInputEvent(InputQueue & queue, const InputEvent & event);
+
+// The oldest event, left in the queue. Returns false when empty.
+bool peekInputEvent(InputQueue & queue, InputEvent & event);
+// Forgets the oldest event
+void popInputEvent(InputQueue & queue);
+// Forgets the events that came up to time
+void dropInputEvents(InputQueue & queue, double time);
+
+#endif
@@ -0,0 +1,181 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "glstate.hpp"
+#include "lightlist.hpp"
+
+LightListStats lightListStats = { 0, 0, 0, 0, 0.0 };
+
+static const GLenum bufferFormats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+void createLightList(LightList & list){
+	list.lights.clear();
+	list.culling = true;
+	list.tilesX = 0;
+	list.tilesY = 0;
+	list.tileLights = 0;
+	std::fill(list.visibleOwners, list.visibleOwners + 8, 0u);
+	glGenBuffers(3, list.buffers);
+	glGenTextures(3, list.textures);
+	for ( int i=0; i<3; i++ ){
+		// Never empty : a texture buffer needs some storage
+		const unsigned int zeros[4] = { 0, 0, 0, 0 };
+		glBindBuffer(GL_TEXTURE_BUFFER, list.buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(zeros), zeros, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, list.textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, bufferFormats[i], list.buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void deleteLightList(LightList & list){
+	glDeleteTextures(3, list.textures);
+	glDeleteBuffers(3, list.buffers);
+	list.lights.clear();
+	list.lightTexels.clear();
+	list.tiles.clear();
+	list.indices.clear();
+	list.lightTiles.clear();
+}
+
+void clearLights(LightList & list){
+	list.lights.clear();
+}
+
+int addLight(LightList & list, const glm::vec3 & position, const glm::vec3 & color, float power, float radius, unsigned int owner){
+	Light light;
+	light.position = position;
+	light.radius   = radius;
+	light.color    = color;
+	light.power    = power;
+	light.owner    = owner;
+	list.lights.push_back(light);
+	return (int)list.lights.size() - 1;
+}
+
+// The tiles a sphere (camera space) can cover : the ones its bounding box
+// projects to. False when it is out of the view.
+static bool sphereTiles(const glm::vec3 & center, float radius, const glm::mat4 & ProjectionMatrix,
+	int width, int height, int tilesX, int tilesY, glm::ivec4 & rect){
+	glm::vec2 low(1e30f), high(-1e30f);
+	int behind = 0;
+	for ( int i=0; i<8; i++ ){
+		glm::vec3 corner = center + radius * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		glm::vec4 clip = ProjectionMatrix * glm::vec4(corner, 1.0f);
+		if ( clip.w <= 1e-6f ){
+			behind++;
+			continue;
+		}
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		low = glm::min(low, ndc);
+		high = glm::max(high, ndc);
+	}
+	if ( behind == 8 )
+		return false;
+	// Around the eye : the projection of the box is unbounded
+	if ( behind > 0 ){
+		low = glm::vec2(-1.0f);
+		high = glm::vec2(1.0f);
+	}
+	if ( high.x < -1.0f || low.x > 1.0f || high.y < -1.0f || low.y > 1.0f )
+		return false;
+
+	rect.x = std::max(0, (int)floorf((low.x * 0.5f + 0.5f) * width / LIGHT_TILE_SIZE));
+	rect.y = std::max(0, (int)floorf((low.y * 0.5f + 0.5f) * height / LIGHT_TILE_SIZE));
+	rect.z = std::min(tilesX - 1, (int)floorf((high.x * 0.5f + 0.5f) * width / LIGHT_TILE_SIZE));
+	rect.w = std::min(tilesY - 1, (int)floorf((high.y * 0.5f + 0.5f) * height / LIGHT_TILE_SIZE));
+	return rect.x <= rect.z && rect.y <= rect.w;
+}
+
+static void uploadTextureBuffer(GLuint buffer, const void * data, size_t size){
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+}
+
+void cullLights(LightList & list, const glm::mat4 & ViewMatrix, const glm::mat4 & ProjectionMatrix, int width, int height){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	list.tilesX = std::max(1, (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE);
+	list.tilesY = std::max(1, (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE);
+	size_t lightCount = list.lights.size();
+	list.lightTexels.resize(std::max<size_t>(2 * lightCount, 1));
+	list.lightTiles.resize(lightCount);
+	list.tiles.assign(list.tilesX * list.tilesY, glm::uvec2(0, 0));
+
+	// Count the lights of each tile...
+	const glm::ivec4 noTiles(0, 0, -1, -1);
+	unsigned long long visible = 0;
+	std::fill(list.visibleOwners, list.visibleOwners + 8, 0u);
+	for ( size_t i=0; i<lightCount; i++ ){
+		const Light & light = list.lights[i];
+		glm::vec3 center = glm::vec3(ViewMatrix * glm::vec4(light.position, 1.0f));
+		list.lightTexels[2 * i] = glm::vec4(center, light.radius);
+		list.lightTexels[2 * i + 1] = glm::vec4(light.color, light.power);
+
+		glm::ivec4 & rect = list.lightTiles[i];
+		rect = glm::ivec4(0, 0, list.tilesX - 1, list.tilesY - 1);
+		if ( light.power <= 0.0f || light.radius <= 0.0f )
+			rect = noTiles;
+		else if ( list.culling && !sphereTiles(center, light.radius, ProjectionMatrix, width, height, list.tilesX, list.tilesY, rect) )
+			rect = noTiles;
+		if ( rect.x > rect.z )
+			continue;
+		visible++;
+		list.visibleOwners[light.owner / 32 % 8] |= 1u << (light.owner % 32);
+		for ( int y=rect.y; y<=rect.w; y++ )
+			for ( int x=rect.x; x<=rect.z; x++ )
+				list.tiles[y * list.tilesX + x].y++;
+	}
+
+	// ...place the lists one after the other...
+	unsigned int offset = 0;
+	for ( size_t t=0; t<list.tiles.size(); t++ ){
+		list.tiles[t].x = offset;
+		offset += list.tiles[t].y;
+		list.tiles[t].y = 0;
+	}
+
+	// ...and fill them, in the order of the lights
+	list.tileLights = offset;
+	list.indices.resize(std::max(offset, 1u));
+	for ( size_t i=0; i<lightCount; i++ ){
+		const glm::ivec4 & rect = list.lightTiles[i];
+		unsigned int entry = (unsigned int)i | (list.lights[i].owner << LIGHT_OWNER_SHIFT);
+		for ( int y=rect.y; y<=rect.w; y++ )
+			for ( int x=rect.x; x<=rect.z; x++ ){
+				glm::uvec2 & tile = list.tiles[y * list.tilesX + x];
+				list.indices[tile.x + tile.y++] = entry;
+			}
+	}
+
+	// With no light in view the shaders do not read the list
+	if ( offset > 0 ){
+		uploadTextureBuffer(list.buffers[0], &list.lightTexels[0], list.lightTexels.size() * sizeof(glm::vec4));
+		uploadTextureBuffer(list.buffers[1], &list.tiles[0], list.tiles.size() * sizeof(glm::uvec2));
+		uploadTextureBuffer(list.buffers[2], &list.indices[0], list.indices.size() * sizeof(unsigned int));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	lightListStats.lights += lightCount;
+	lightListStats.visible += visible;
+	lightListStats.tileLights += offset;
+	lightListStats.tiles += list.tiles.size();
+	lightListStats.cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ownerLightsInView(const LightList & list, unsigned int owner){
+	return owner < 256 && (list.visibleOwners[owner / 32] >> (owner % 32) & 1u) != 0;
+}
+
+void bindLightList(const LightList & list){
+	const GLenum units[3] = { LIGHT_BUFFER_UNIT, LIGHT_TILE_UNIT, LIGHT_INDEX_UNIT };
+	for ( int i=0; i<3; i++ )
+		bindTexture(units[i], GL_TEXTURE_BUFFER, list.textures[i]);
+	activeTexture(0);
+}
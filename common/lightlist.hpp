@@ -0,0 +1,80 @@
+#ifndef LIGHTLIST_HPP
+#define LIGHTLIST_HPP
+
+// The screen is cut into square tiles this many pixels wide, each with the
+// list of the lights that reach it
+#define LIGHT_TILE_SIZE 16
+
+// Texture units of the three buffers of the list; unit 0 is the texture array
+#define LIGHT_BUFFER_UNIT 1
+#define LIGHT_TILE_UNIT   2
+#define LIGHT_INDEX_UNIT  3
+
+// The entries of the tiles' lists are a light's index, with its owner in the
+// bits above this one
+#define LIGHT_OWNER_SHIFT 24
+
+// A point light. It fades out to nothing at radius, so that it only has to
+// be shaded where its sphere is. A light with an owner only lights the draws
+// of that owner, whatever else its sphere reaches.
+struct Light{
+	glm::vec3 position; // World space
+	float radius;
+	glm::vec3 color;
+	float power;
+	unsigned int owner; // 0 lights every draw, otherwise 1 to 255
+};
+
+// Any number of lights, and for each tile of the screen the ones whose
+// sphere covers it. The fragment shader reads them from texture buffers :
+//   lights  : two RGBA32F texels per light, camera space position and radius, then colour and power
+//   tiles   : one RG32UI texel per tile, its first index and its count
+//   indices : R32UI, the lights of every tile, one tile after the other, with
+//             their owner from LIGHT_OWNER_SHIFT up
+struct LightList{
+	std::vector<Light> lights;
+	bool culling; // false lists every light in every tile, as a reference
+	int tilesX, tilesY;
+	GLuint buffers[3];  // lights, tiles, indices
+	GLuint textures[3];
+	// Built by cullLights
+	std::vector<glm::vec4> lightTexels;
+	std::vector<glm::uvec2> tiles;
+	std::vector<unsigned int> indices;
+	std::vector<glm::ivec4> lightTiles; // The tiles of each light, x0 y0 x1 y1, empty when culled
+	unsigned int tileLights; // Entries of the tiles' lists, 0 when no light is in view
+	unsigned int visibleOwners[8]; // Bit n : a light of owner n is in at least one tile
+};
+void createLightList(LightList & list);
+void deleteLightList(LightList & list);
+
+// Forgets the lights of the last frame
+void clearLights(LightList & list);
+
+// Adds a light and returns its index. A light with no power is never shaded.
+int addLight(LightList & list, const glm::vec3 & position, const glm::vec3 & color, float power, float radius, unsigned int owner = 0);
+
+// Lists the lights of each tile of a viewport width x height pixels seen
+// through these matrices, and uploads the three buffers, one glBufferData
+// each, unless no light is in view. The view matrix must keep distances
+// (no scaling).
+void cullLights(LightList & list, const glm::mat4 & ViewMatrix, const glm::mat4 & ProjectionMatrix, int width, int height);
+
+// Whether the last cullLights found a light of this owner in view
+bool ownerLightsInView(const LightList & list, unsigned int owner);
+
+// Binds the buffers on their texture units (unless they are already, see
+// glstate.hpp), and leaves unit 0 active
+void bindLightList(const LightList & list);
+
+// What cullLights did since the last reset
+struct LightListStats{
+	unsigned long long lights;      // Added
+	unsigned long long visible;     // In at least one tile
+	unsigned long long tileLights;  // Entries of the tiles' lists
+	unsigned long long tiles;
+	double cullMs;
+};
+extern LightListStats lightListStats;
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedfile.hpp"
+
+bool statFile(const char * path, unsigned long long & size, long long & mtime){
+#ifdef _WIN32
+	struct _stat64 st;
+	if ( _stat64(path, &st) != 0 )
+		return false;
+#else
+	struct stat st;
+	if ( stat(path, &st) != 0 )
+		return false;
+#endif
+	size  = (unsigned long long)st.st_size;
+	mtime = (long long)st.st_mtime;
+	return true;
+}
+
+bool mapFile(const char * path, MappedFile & file){
+	memset(&file, 0, sizeof(MappedFile));
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if ( handle == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx(handle, &size) ){
+		CloseHandle(handle);
+		return false;
+	}
+	if ( !statFile(path, file.size, file.mtime) ){
+		CloseHandle(handle);
+		return false;
+	}
+	file.size = (unsigned long long)size.QuadPart;
+	file.fileHandle = handle;
+	if ( file.size == 0 )
+		return true;
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if ( mapping == NULL ){
+		CloseHandle(handle);
+		return false;
+	}
+	file.mappingHandle = mapping;
+	file.data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if ( file.data == NULL ){
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat(fd, &st) != 0 ){
+		close(fd);
+		return false;
+	}
+	file.size  = (unsigned long long)st.st_size;
+	file.mtime = (long long)st.st_mtime;
+
+	if ( file.size > 0 ){
+#ifdef MAP_POPULATE
+		// Every caller reads the whole file : fault it in with one call
+		int flags = MAP_PRIVATE | MAP_POPULATE;
+#else
+		int flags = MAP_PRIVATE;
+#endif
+		void * data = mmap(NULL, (size_t)file.size, PROT_READ, flags, fd, 0);
+		if ( data == MAP_FAILED ){
+			close(fd);
+			return false;
+		}
+		file.data = (const unsigned char *)data;
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+#ifdef _WIN32
+	if ( file.data )
+		UnmapViewOfFile(file.data);
+	if ( file.mappingHandle )
+		CloseHandle(file.mappingHandle);
+	if ( file.fileHandle )
+		CloseHandle(file.fileHandle);
+#else
+	if ( file.data )
+		munmap((void *)file.data, (size_t)file.size);
+#endif
+	memset(&file, 0, sizeof(MappedFile));
+}
+
+unsigned long long hashBytes(const void * data, unsigned long long size, unsigned long long seed){
+	const unsigned long long prime = 1099511628211ULL;
+	const unsigned char * bytes = (const unsigned char *)data;
+	unsigned long long hash = seed ^ size;
+
+	// Whole words first ...
+	unsigned long long i = 0;
+	for ( ; i + 8 <= size; i += 8 ){
+		unsigned long long word;
+		memcpy(&word, bytes + i, 8);
+		hash ^= word;
+		hash *= prime;
+		hash ^= hash >> 29;
+	}
+	// ... then the remaining bytes
+	for ( ; i < size; i++ ){
+		hash ^= bytes[i];
+		hash *= prime;
+	}
+	hash ^= hash >> 32;
+	return hash;
+}
@@ -0,0 +1,25 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+// A whole file mapped read-only into memory.
+struct MappedFile{
+	const unsigned char * data;
+	unsigned long long size;
+	long long mtime; // Last modification time, in seconds since the epoch
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#endif
+};
+
+// Maps the file at path. Empty files are "mapped" with data == NULL.
+bool mapFile(const char * path, MappedFile & file);
+void unmapFile(MappedFile & file);
+
+// Reads the size and modification time of a file without opening it.
+bool statFile(const char * path, unsigned long long & size, long long & mtime);
+
+// 64-bit FNV-1a style hash, consuming 8 bytes per step.
+unsigned long long hashBytes(const void * data, unsigned long long size, unsigned long long seed = 14695981039346656037ULL);
+
+#endif
@@ -0,0 +1,727 @@
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+#include "glcalls.hpp"
+#include "glstate.hpp"
+#include "mesh.hpp"
+#include "texture.hpp"
+#include "lightlist.hpp"
+#include "shading.hpp"
+
+MeshAttributes getMeshAttributes(GLuint programID){
+	MeshAttributes attributes;
+	attributes.position = glGetAttribLocation(programID, "vertexPosition_modelspace");
+	attributes.uv       = glGetAttribLocation(programID, "vertexUV");
+	attributes.normal   = glGetAttribLocation(programID, "vertexNormal_modelspace");
+	attributes.drawIndex = glGetAttribLocation(programID, "vertexDrawIndex");
+	attributes.positionOffset = glGetUniformLocation(programID, "PositionOffset_modelspace");
+	attributes.positionScale  = glGetUniformLocation(programID, "PositionScale_modelspace");
+	return attributes;
+}
+
+// Records one attribute of the interleaved buffer in the bound vertex array
+static void setAttribute(GLint location, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset){
+	if ( location < 0 )
+		return;
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, size, type, normalized, stride, (void*)offset);
+}
+
+// Records the attributes of MeshVertex or PackedMeshVertex, with the vertex buffer bound
+static void setMeshAttributes(const MeshAttributes & attributes, bool quantized){
+	if ( quantized ){
+		setAttribute(attributes.position, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedMeshVertex), offsetof(PackedMeshVertex, position));
+		setAttribute(attributes.uv,       2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedMeshVertex), offsetof(PackedMeshVertex, uv));
+		setAttribute(attributes.normal,   4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedMeshVertex), offsetof(PackedMeshVertex, normal));
+	}else{
+		setAttribute(attributes.position, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), offsetof(MeshVertex, position));
+		setAttribute(attributes.uv,       2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), offsetof(MeshVertex, uv));
+		setAttribute(attributes.normal,   3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), offsetof(MeshVertex, normal));
+	}
+}
+
+// Positions become 16-bit fractions of the mesh bounds, normals 10-bit
+// signed fractions, UVs half floats. Every vertex is decoded again to measure
+// the error.
+static void quantizeVertices(
+	const IndexedMesh & data,
+	std::vector<PackedMeshVertex> & packed,
+	glm::vec3 & offset,
+	glm::vec3 & scale,
+	MeshQuantizationError & error
+){
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	for ( unsigned int i=0; i<data.vertexCount; i++ ){
+		minimum = i == 0 ? data.vertices[i] : glm::min(minimum, data.vertices[i]);
+		maximum = i == 0 ? data.vertices[i] : glm::max(maximum, data.vertices[i]);
+	}
+	offset = minimum;
+	scale = maximum - minimum;
+
+	error.position = 0.0f;
+	error.normal = 0.0f;
+	error.uv = 0.0f;
+	packed.resize(data.vertexCount);
+	for ( unsigned int i=0; i<data.vertexCount; i++ ){
+		PackedMeshVertex & vertex = packed[i];
+
+		for ( int c=0; c<3; c++ ){
+			float fraction = scale[c] > 0.0f ? (data.vertices[i][c] - offset[c]) / scale[c] : 0.0f;
+			vertex.position[c] = glm::packUnorm1x16(fraction);
+			float decoded = offset[c] + scale[c] * glm::unpackUnorm1x16(vertex.position[c]);
+			error.position = std::max(error.position, fabsf(decoded - data.vertices[i][c]));
+		}
+		vertex.position[3] = 0;
+
+		glm::vec3 normal = data.normals[i];
+		if ( glm::length(normal) > 0.0f )
+			normal = glm::normalize(normal);
+		vertex.normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+		glm::vec3 decodedNormal = glm::vec3(glm::unpackSnorm3x10_1x2(vertex.normal));
+		if ( glm::length(normal) > 0.0f && glm::length(decodedNormal) > 0.0f ){
+			float cosine = glm::clamp(glm::dot(normal, glm::normalize(decodedNormal)), -1.0f, 1.0f);
+			error.normal = std::max(error.normal, glm::degrees(acosf(cosine)));
+		}
+
+		for ( int c=0; c<2; c++ ){
+			vertex.uv[c] = glm::packHalf1x16(data.uvs[i][c]);
+			error.uv = std::max(error.uv, fabsf(glm::unpackHalf1x16(vertex.uv[c]) - data.uvs[i][c]));
+		}
+	}
+}
+
+// The bounding box of the vertices, and the sphere around it
+static void computeBounds(const glm::vec3 * vertices, unsigned int count, Mesh & mesh){
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	for ( unsigned int i=0; i<count; i++ ){
+		minimum = i == 0 ? vertices[i] : glm::min(minimum, vertices[i]);
+		maximum = i == 0 ? vertices[i] : glm::max(maximum, vertices[i]);
+	}
+	mesh.boundsMin = minimum;
+	mesh.boundsMax = maximum;
+	mesh.boundsCenter = (minimum + maximum) * 0.5f;
+	mesh.boundsRadius = glm::length(maximum - minimum) * 0.5f;
+}
+
+void createMesh(const IndexedMesh & data, const MeshAttributes & attributes, Mesh & mesh, bool quantize, MeshQuantizationError * error){
+	std::vector<MeshVertex> vertices;
+	std::vector<PackedMeshVertex> packedVertices;
+	MeshQuantizationError quantizationError;
+	mesh.positionOffset = glm::vec3(0.0f);
+	mesh.positionScale = glm::vec3(1.0f);
+	if ( quantize ){
+		quantizeVertices(data, packedVertices, mesh.positionOffset, mesh.positionScale, quantizationError);
+		if ( error != NULL )
+			*error = quantizationError;
+	}else{
+		vertices.resize(data.vertexCount);
+		for ( unsigned int i=0; i<data.vertexCount; i++ ){
+			vertices[i].position = data.vertices[i];
+			vertices[i].uv       = data.uvs[i];
+			vertices[i].normal   = data.normals[i];
+		}
+	}
+	mesh.vertexSize = quantize ? sizeof(PackedMeshVertex) : sizeof(MeshVertex);
+
+	glGenVertexArrays(1, &mesh.vertexArray);
+	bindVertexArray(mesh.vertexArray);
+
+	glGenBuffers(1, &mesh.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+	if ( quantize )
+		glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedMeshVertex), packedVertices.data(), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+
+	// The element buffer binding is part of the vertex array state
+	glGenBuffers(1, &mesh.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexCount * data.indexSize, data.indices, GL_STATIC_DRAW);
+
+	setMeshAttributes(attributes, quantize);
+
+	bindVertexArray(0);
+
+	mesh.vertexCount = data.vertexCount;
+	mesh.indexCount  = data.indexCount;
+	mesh.indexType   = data.indexSize == sizeof(unsigned int) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	mesh.chunks      = data.chunks;
+	mesh.lods        = data.lods;
+	if ( mesh.lods.empty() ){
+		MeshLod full = { 0, data.indexCount, 0.0f };
+		mesh.lods.push_back(full);
+	}
+	computeBounds(data.vertices, data.vertexCount, mesh);
+	mesh.positionOffsetID = attributes.positionOffset;
+	mesh.positionScaleID  = attributes.positionScale;
+	mesh.arenaVertexArray = 0;
+	mesh.arenaDepthVertexArray = 0;
+	mesh.arenaBaseVertex  = 0;
+	mesh.arenaFirstIndex  = 0;
+}
+
+MeshDrawStats meshDrawStats = { 0, 0 };
+
+void drawMesh(const Mesh & mesh, unsigned int lod){
+	MeshAttributes attributes;
+	attributes.positionOffset = mesh.positionOffsetID;
+	attributes.positionScale  = mesh.positionScaleID;
+	drawMesh(mesh, lod, attributes);
+}
+
+void drawMesh(const Mesh & mesh, unsigned int lod, const MeshAttributes & attributes){
+	// Float meshes set the identity too, the previous draw may have been quantized
+	if ( attributes.positionOffset >= 0 )
+		glUniform3fv(attributes.positionOffset, 1, &mesh.positionOffset[0]);
+	if ( attributes.positionScale >= 0 )
+		glUniform3fv(attributes.positionScale, 1, &mesh.positionScale[0]);
+
+	bindVertexArray(mesh.vertexArray);
+	if ( mesh.chunks.empty() ){
+		const MeshLod & level = mesh.lods[std::min<size_t>(lod, mesh.lods.size() - 1)];
+		size_t indexSize = mesh.indexType == GL_UNSIGNED_INT ? sizeof(unsigned int) : sizeof(unsigned short);
+		glDrawElements(GL_TRIANGLES, level.indexCount, mesh.indexType, (void*)(level.firstIndex * indexSize));
+		meshDrawStats.triangles += level.indexCount / 3;
+		meshDrawStats.fullDetailTriangles += mesh.lods[0].indexCount / 3;
+		return;
+	}
+	for ( size_t i=0; i<mesh.chunks.size(); i++ ){
+		const MeshChunk & chunk = mesh.chunks[i];
+		glDrawElementsBaseVertex(GL_TRIANGLES, chunk.indexCount, GL_UNSIGNED_SHORT,
+			(void*)(chunk.firstIndex * sizeof(unsigned short)), chunk.baseVertex);
+	}
+	meshDrawStats.triangles += mesh.indexCount / 3;
+	meshDrawStats.fullDetailTriangles += mesh.indexCount / 3;
+}
+
+unsigned int selectMeshLod(
+	const Mesh & mesh,
+	const glm::mat4 & ProjectionMatrix,
+	const glm::mat4 & ViewMatrix,
+	const glm::mat4 & ModelMatrix,
+	float viewportHeight,
+	float pixelError
+){
+	if ( mesh.lods.size() < 2 )
+		return 0;
+
+	// Largest scale of the model matrix : the errors are in model units
+	float modelScale = std::max(glm::length(glm::vec3(ModelMatrix[0])),
+		std::max(glm::length(glm::vec3(ModelMatrix[1])), glm::length(glm::vec3(ModelMatrix[2]))));
+	glm::vec4 center = ViewMatrix * ModelMatrix * glm::vec4(mesh.boundsCenter, 1.0f);
+	if ( glm::length(glm::vec3(center)) <= mesh.boundsRadius * modelScale )
+		return 0;
+
+	// w is the distance for a perspective projection and 1 for an orthographic one
+	float w = (ProjectionMatrix * center).w;
+	if ( w <= 0.0f )
+		return 0;
+	float pixelsPerUnit = ProjectionMatrix[1][1] * 0.5f * viewportHeight / w * modelScale;
+
+	for ( size_t lod=mesh.lods.size() - 1; lod>0; lod-- )
+		if ( mesh.lods[lod].error * pixelsPerUnit < pixelError )
+			return (unsigned int)lod;
+	return 0;
+}
+
+void deleteMesh(Mesh & mesh){
+	glDeleteVertexArrays(1, &mesh.vertexArray);
+	glDeleteBuffers(1, &mesh.vertexBuffer);
+	glDeleteBuffers(1, &mesh.indexBuffer);
+	mesh.vertexArray = 0;
+	mesh.vertexBuffer = 0;
+	mesh.indexBuffer = 0;
+}
+
+// The indices of a mesh relative to its first vertex, chunks included
+static void absoluteIndices(const IndexedMesh & mesh, std::vector<unsigned int> & indices){
+	indices.resize(mesh.indexCount);
+	for ( unsigned int i=0; i<mesh.indexCount; i++ )
+		indices[i] = mesh.indexSize == sizeof(unsigned int) ? ((const unsigned int *)mesh.indices)[i] : ((const unsigned short *)mesh.indices)[i];
+	for ( size_t c=0; c<mesh.chunks.size(); c++ )
+		for ( unsigned int i=0; i<mesh.chunks[c].indexCount; i++ )
+			indices[mesh.chunks[c].firstIndex + i] += mesh.chunks[c].baseVertex;
+}
+
+void createStaticBatch(const IndexedMesh * const * meshes, const glm::mat4 * transforms, int count,
+	const MeshAttributes & attributes, StaticBatch & batch, bool quantize){
+	IndexedMesh merged;
+	std::vector<unsigned int> firstVertex(count);
+	size_t levelCount = 1;
+	for ( int i=0; i<count; i++ ){
+		const IndexedMesh & mesh = *meshes[i];
+		firstVertex[i] = (unsigned int)merged.ownedVertices.size();
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transforms[i])));
+		for ( unsigned int v=0; v<mesh.vertexCount; v++ ){
+			merged.ownedVertices.push_back(glm::vec3(transforms[i] * glm::vec4(mesh.vertices[v], 1.0f)));
+			merged.ownedUvs.push_back(mesh.uvs[v]);
+			glm::vec3 normal = normalMatrix * mesh.normals[v];
+			merged.ownedNormals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+		}
+		levelCount = std::max(levelCount, mesh.lods.size());
+	}
+
+	// Level by level, every part at that level (or at its coarsest one) : a
+	// level of the batch is one range of the index buffer too
+	std::vector< std::vector<unsigned int> > partIndices(count);
+	for ( int i=0; i<count; i++ )
+		absoluteIndices(*meshes[i], partIndices[i]);
+	std::vector<unsigned int> indices;
+	std::vector< std::vector<MeshLod> > partLods(count);
+	for ( size_t l=0; l<levelCount; l++ ){
+		MeshLod level = { (unsigned int)indices.size(), 0, 0.0f };
+		for ( int i=0; i<count; i++ ){
+			const IndexedMesh & mesh = *meshes[i];
+			MeshLod source = { 0, mesh.indexCount, 0.0f };
+			if ( !mesh.lods.empty() )
+				source = mesh.lods[std::min(l, mesh.lods.size() - 1)];
+			// The errors are in model units, and the transform may scale them
+			float scale = std::max(glm::length(glm::vec3(transforms[i][0])),
+				std::max(glm::length(glm::vec3(transforms[i][1])), glm::length(glm::vec3(transforms[i][2]))));
+			MeshLod part = { (unsigned int)indices.size(), source.indexCount, source.error * scale };
+			for ( unsigned int k=0; k<source.indexCount; k++ )
+				indices.push_back(firstVertex[i] + partIndices[i][source.firstIndex + k]);
+			partLods[i].push_back(part);
+			level.error = std::max(level.error, part.error);
+		}
+		level.indexCount = (unsigned int)indices.size() - level.firstIndex;
+		merged.lods.push_back(level);
+	}
+
+	merged.vertices    = merged.ownedVertices.data();
+	merged.uvs         = merged.ownedUvs.data();
+	merged.normals     = merged.ownedNormals.data();
+	merged.vertexCount = (unsigned int)merged.ownedVertices.size();
+	merged.indexCount  = (unsigned int)indices.size();
+	if ( merged.vertexCount <= 65536 ){
+		merged.ownedIndices16.assign(indices.begin(), indices.end());
+		merged.indices   = merged.ownedIndices16.data();
+		merged.indexSize = sizeof(unsigned short);
+	}else{
+		merged.ownedIndices32.swap(indices);
+		merged.indices   = merged.ownedIndices32.data();
+		merged.indexSize = sizeof(unsigned int);
+	}
+	merged.acmrBefore = 0.0f;
+	merged.acmrAfter  = 0.0f;
+	merged.fromCache  = false;
+	createMesh(merged, attributes, batch.merged, quantize);
+
+	batch.parts.assign(count, batch.merged);
+	for ( int i=0; i<count; i++ ){
+		batch.parts[i].lods = partLods[i];
+		computeBounds(&merged.ownedVertices[firstVertex[i]], meshes[i]->vertexCount, batch.parts[i]);
+	}
+}
+
+void deleteStaticBatch(StaticBatch & batch){
+	deleteMesh(batch.merged);
+	batch.parts.clear();
+}
+
+// Whether a mesh can go into an arena of vertices vertexSize bytes : its
+// indices (every chunk's too) are 16-bit
+static bool fitsMeshArena(const Mesh & mesh, unsigned int vertexSize){
+	return mesh.vertexArray != 0 && mesh.vertexSize == vertexSize && mesh.indexType == GL_UNSIGNED_SHORT;
+}
+
+void createMeshArena(MeshArena & arena, Mesh * const * meshes, int count, const MeshAttributes & attributes, unsigned int drawIndices){
+	arena.vertexSize = 0;
+	for ( int i=0; i<count && arena.vertexSize == 0; i++ )
+		if ( meshes[i]->vertexArray != 0 )
+			arena.vertexSize = meshes[i]->vertexSize;
+
+	// Place every mesh, once per vertex buffer
+	std::vector<const Mesh *> placed;
+	arena.vertexCount = 0;
+	arena.indexCount = 0;
+	for ( int i=0; i<count; i++ ){
+		Mesh & mesh = *meshes[i];
+		mesh.arenaVertexArray = 0;
+		mesh.arenaDepthVertexArray = 0;
+		if ( !fitsMeshArena(mesh, arena.vertexSize) )
+			continue;
+		size_t p = 0;
+		while ( p < placed.size() && placed[p]->vertexBuffer != mesh.vertexBuffer )
+			p++;
+		if ( p < placed.size() ){
+			mesh.arenaBaseVertex = placed[p]->arenaBaseVertex;
+			mesh.arenaFirstIndex = placed[p]->arenaFirstIndex;
+		}else{
+			mesh.arenaBaseVertex = arena.vertexCount;
+			mesh.arenaFirstIndex = arena.indexCount;
+			arena.vertexCount += mesh.vertexCount;
+			arena.indexCount += mesh.indexCount;
+			placed.push_back(&mesh);
+		}
+	}
+	arena.meshCount = (unsigned int)placed.size();
+
+	glGenVertexArrays(1, &arena.vertexArray);
+	bindVertexArray(arena.vertexArray);
+	glGenBuffers(1, &arena.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, std::max(arena.vertexCount * arena.vertexSize, 1u), NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &arena.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, std::max(arena.indexCount * (unsigned int)sizeof(unsigned short), 1u), NULL, GL_STATIC_DRAW);
+
+	// The indices stay relative to their mesh : the draws add the base vertex
+	glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBuffer);
+	for ( size_t p=0; p<placed.size(); p++ ){
+		glBindBuffer(GL_COPY_READ_BUFFER, placed[p]->vertexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+			placed[p]->arenaBaseVertex * arena.vertexSize, placed[p]->vertexCount * arena.vertexSize);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBuffer);
+	for ( size_t p=0; p<placed.size(); p++ ){
+		glBindBuffer(GL_COPY_READ_BUFFER, placed[p]->indexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+			placed[p]->arenaFirstIndex * sizeof(unsigned short), placed[p]->indexCount * sizeof(unsigned short));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBuffer);
+	setMeshAttributes(attributes, arena.vertexSize == sizeof(PackedMeshVertex));
+
+	arena.drawIndexBuffer = 0;
+	if ( drawIndices > 0 && attributes.drawIndex >= 0 ){
+		std::vector<GLint> indices(drawIndices);
+		for ( unsigned int i=0; i<drawIndices; i++ )
+			indices[i] = (GLint)i;
+		glGenBuffers(1, &arena.drawIndexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, arena.drawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLint), indices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(attributes.drawIndex);
+		glVertexAttribIPointer(attributes.drawIndex, 1, GL_INT, sizeof(GLint), (void*)0);
+		glVertexAttribDivisor(attributes.drawIndex, 1);
+	}
+	bindVertexArray(0);
+
+	// The depth stream : the first field of either vertex, without the others
+	bool quantized = arena.vertexSize == sizeof(PackedMeshVertex);
+	unsigned int positionSize = quantized ? sizeof(PackedMeshVertex::position) : sizeof(glm::vec3);
+	std::vector<unsigned char> vertices(arena.vertexCount * arena.vertexSize);
+	std::vector<unsigned char> positions(std::max(arena.vertexCount * positionSize, 1u));
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBuffer);
+	if ( !vertices.empty() )
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size(), vertices.data());
+	for ( unsigned int v=0; v<arena.vertexCount; v++ )
+		memcpy(&positions[v * positionSize], &vertices[v * arena.vertexSize], positionSize);
+
+	glGenVertexArrays(1, &arena.depthVertexArray);
+	bindVertexArray(arena.depthVertexArray);
+	glGenBuffers(1, &arena.positionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.positionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBuffer);
+	if ( quantized )
+		setAttribute(attributes.position, 3, GL_UNSIGNED_SHORT, GL_TRUE, positionSize, 0);
+	else
+		setAttribute(attributes.position, 3, GL_FLOAT, GL_FALSE, positionSize, 0);
+	if ( arena.drawIndexBuffer != 0 ){
+		glBindBuffer(GL_ARRAY_BUFFER, arena.drawIndexBuffer);
+		glEnableVertexAttribArray(attributes.drawIndex);
+		glVertexAttribIPointer(attributes.drawIndex, 1, GL_INT, sizeof(GLint), (void*)0);
+		glVertexAttribDivisor(attributes.drawIndex, 1);
+	}
+	bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for ( int i=0; i<count; i++ )
+		if ( fitsMeshArena(*meshes[i], arena.vertexSize) ){
+			meshes[i]->arenaVertexArray = arena.vertexArray;
+			meshes[i]->arenaDepthVertexArray = arena.depthVertexArray;
+		}
+}
+
+void deleteMeshArena(MeshArena & arena){
+	glDeleteVertexArrays(1, &arena.vertexArray);
+	glDeleteVertexArrays(1, &arena.depthVertexArray);
+	glDeleteBuffers(1, &arena.vertexBuffer);
+	glDeleteBuffers(1, &arena.positionBuffer);
+	glDeleteBuffers(1, &arena.indexBuffer);
+	if ( arena.drawIndexBuffer != 0 )
+		glDeleteBuffers(1, &arena.drawIndexBuffer);
+	arena.vertexArray = 0;
+	arena.vertexBuffer = 0;
+	arena.indexBuffer = 0;
+	arena.drawIndexBuffer = 0;
+	arena.positionBuffer = 0;
+	arena.depthVertexArray = 0;
+}
+
+unsigned int addMeshDrawCommands(const Mesh & mesh, unsigned int lod, unsigned int baseInstance, std::vector<MeshDrawCommand> & commands){
+	if ( mesh.chunks.empty() ){
+		const MeshLod & level = mesh.lods[std::min<size_t>(lod, mesh.lods.size() - 1)];
+		MeshDrawCommand command = { level.indexCount, 1, mesh.arenaFirstIndex + level.firstIndex, (GLint)mesh.arenaBaseVertex, baseInstance };
+		commands.push_back(command);
+		meshDrawStats.triangles += level.indexCount / 3;
+		meshDrawStats.fullDetailTriangles += mesh.lods[0].indexCount / 3;
+		return 1;
+	}
+	for ( size_t i=0; i<mesh.chunks.size(); i++ ){
+		const MeshChunk & chunk = mesh.chunks[i];
+		MeshDrawCommand command = { chunk.indexCount, 1, mesh.arenaFirstIndex + chunk.firstIndex, (GLint)(mesh.arenaBaseVertex + chunk.baseVertex), baseInstance };
+		commands.push_back(command);
+	}
+	meshDrawStats.triangles += mesh.indexCount / 3;
+	meshDrawStats.fullDetailTriangles += mesh.indexCount / 3;
+	return (unsigned int)mesh.chunks.size();
+}
+
+// The previous path, kept as the reference for benchmarkMeshBinding :
+// three separate vertex buffers, and every draw looks up the attributes and
+// rebinds everything.
+struct SeparateBuffers{
+	GLuint vertexbuffer;
+	GLuint uvbuffer;
+	GLuint normalbuffer;
+	GLuint elementbuffer;
+};
+
+static void loadSeparateBuffers(const IndexedMesh & mesh, SeparateBuffers & buffers){
+	glGenBuffers(1, &buffers.vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &buffers.uvbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.uvbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec2), mesh.uvs, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &buffers.normalbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.normalbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.normals, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &buffers.elementbuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.elementbuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+}
+
+static void bindSeparateBuffers(const SeparateBuffers & buffers, GLuint programID){
+	GLuint vertexPosition_modelspaceID = glGetAttribLocation(programID, "vertexPosition_modelspace");
+	GLuint vertexUVID = glGetAttribLocation(programID, "vertexUV");
+	GLuint vertexNormal_modelspaceID = glGetAttribLocation(programID, "vertexNormal_modelspace");
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+	glVertexAttribPointer(vertexPosition_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.uvbuffer);
+	glVertexAttribPointer(vertexUVID, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.normalbuffer);
+	glVertexAttribPointer(vertexNormal_modelspaceID, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.elementbuffer);
+}
+
+static void drawSeparateBuffers(const IndexedMesh & mesh){
+	GLenum type = mesh.indexSize == sizeof(unsigned int) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	if ( mesh.chunks.empty() ){
+		glDrawElements(GL_TRIANGLES, mesh.indexCount, type, (void*)0);
+		return;
+	}
+	for ( size_t i=0; i<mesh.chunks.size(); i++ )
+		glDrawElementsBaseVertex(GL_TRIANGLES, mesh.chunks[i].indexCount, GL_UNSIGNED_SHORT,
+			(void*)(mesh.chunks[i].firstIndex * sizeof(unsigned short)), mesh.chunks[i].baseVertex);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkMeshBinding(const char * const * paths, int count, unsigned int flags, GLuint programID){
+	const int frames = 200;
+
+	std::vector<IndexedMesh> data(count);
+	std::vector<SeparateBuffers> separate(count);
+	std::vector<Mesh> meshes(count);
+	MeshAttributes attributes = getMeshAttributes(programID);
+	for ( int i=0; i<count; i++ ){
+		loadIndexedOBJ(paths[i], data[i], flags);
+		loadSeparateBuffers(data[i], separate[i]);
+		createMesh(data[i], attributes, meshes[i]);
+		releaseMeshData(data[i]);
+	}
+	useProgram(programID);
+
+	// Core profile : the previous path needs some vertex array bound
+	GLuint sharedVertexArray;
+	glGenVertexArrays(1, &sharedVertexArray);
+	bindVertexArray(sharedVertexArray);
+	glFinish();
+
+	startCountingGLCalls();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for ( int frame=0; frame<frames; frame++ ){
+		for ( int i=0; i<count; i++ ){
+			bindSeparateBuffers(separate[i], programID);
+			drawSeparateBuffers(data[i]);
+		}
+		glDisableVertexAttribArray(0);
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(2);
+	}
+	double separateMs = elapsedMs(start) / frames;
+	double separateCalls = (double)countedGLCalls() / frames;
+	glFinish();
+
+	resetGLCallCount();
+	start = std::chrono::steady_clock::now();
+	for ( int frame=0; frame<frames; frame++ ){
+		for ( int i=0; i<count; i++ )
+			drawMesh(meshes[i]);
+		bindVertexArray(0);
+	}
+	double meshMs = elapsedMs(start) / frames;
+	double meshCalls = (double)countedGLCalls() / frames;
+	glFinish();
+	stopCountingGLCalls();
+
+	printf("%d meshes, %d frames, draw calls not counted (GL 1.1 entry points)\n", count, frames);
+	printf("%-28s %14s %14s\n", "path", "GL calls/frame", "CPU ms/frame");
+	printf("%-28s %14.0f %14.3f\n", "separate buffers", separateCalls, separateMs);
+	printf("%-28s %14.0f %14.3f\n", "interleaved Mesh + VAO", meshCalls, meshMs);
+
+	bindVertexArray(0);
+	glDeleteVertexArrays(1, &sharedVertexArray);
+	for ( int i=0; i<count; i++ ){
+		glDeleteBuffers(1, &separate[i].vertexbuffer);
+		glDeleteBuffers(1, &separate[i].uvbuffer);
+		glDeleteBuffers(1, &separate[i].normalbuffer);
+		glDeleteBuffers(1, &separate[i].elementbuffer);
+		deleteMesh(meshes[i]);
+	}
+}
+
+// Draws mesh centred in the framebuffer and reads the pixels back
+static void renderForComparison(const Mesh & mesh, glm::vec3 center, float radius, Shading & shading, const TextureLayer & texture, int size, std::vector<unsigned char> & pixels){
+	glm::vec3 eye = center + glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f)) * radius * 2.5f;
+	glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(45.0f), 1.0f, radius * 0.1f, radius * 10.0f);
+	glm::mat4 ViewMatrix = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 ModelMatrix = glm::mat4(1.0f);
+	// The white light is 100 / distance², about 1 at 10 units
+	glm::vec3 lightPosition = center + glm::normalize(eye - center) * std::max(10.0f, radius * 2.5f);
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	beginShadingFrame(shading);
+	int light = addShadingLight(shading, lightPosition, glm::vec3(1.0f), 100.0f);
+	addShadingDraw(shading, mesh, 0, texture, ModelMatrix, light, false);
+	drawShadingFrame(shading, ViewMatrix, ProjectionMatrix, size, size);
+	bindVertexArray(0);
+	pixels.resize(size * size * 4);
+	glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+void compareMeshQuantization(const char * const * paths, int count, unsigned int flags, Shading & shading){
+	const int size = 512;
+	const MeshAttributes & attributes = shading.lit.attributes;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLuint framebuffer, colorbuffer, depthbuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &colorbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorbuffer);
+	glGenRenderbuffers(1, &depthbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+	glViewport(0, 0, size, size);
+	glEnable(GL_DEPTH_TEST);
+
+	// A checkerboard, so that UV errors show up in the pixels
+	const int textureSize = 64;
+	std::vector<unsigned char> checker(textureSize * textureSize * 3);
+	for ( int y=0; y<textureSize; y++ )
+		for ( int x=0; x<textureSize; x++ )
+			for ( int c=0; c<3; c++ )
+				checker[(y * textureSize + x) * 3 + c] = ((x / 8 + y / 8) & 1) ? 255 : 64;
+	// A one-layer array : StandardShading samples a sampler2DArray
+	TextureLayer texture = { 0, 0.0f, { 0.0f, 0.0f, 1.0f, 1.0f }, -1.0f };
+	glGenTextures(1, &texture.texture);
+	bindTexture(0, GL_TEXTURE_2D_ARRAY, texture.texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, textureSize, textureSize, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, checker.data());
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	resetGLState();
+
+	printf("%-26s %8s %10s %10s %11s %10s %10s %14s %9s %9s\n",
+		"mesh", "vertices", "float KB", "packed KB", "pos error", "normal deg", "uv error", "pixels differ", "by > 16", "max diff");
+	unsigned long long floatBytes = 0, packedBytes = 0;
+	for ( int i=0; i<count; i++ ){
+		IndexedMesh data;
+		if ( !loadIndexedOBJ(paths[i], data, flags) || data.vertexCount == 0 )
+			continue;
+
+		glm::vec3 minimum = data.vertices[0], maximum = data.vertices[0];
+		for ( unsigned int v=1; v<data.vertexCount; v++ ){
+			minimum = glm::min(minimum, data.vertices[v]);
+			maximum = glm::max(maximum, data.vertices[v]);
+		}
+		glm::vec3 center = (minimum + maximum) * 0.5f;
+		float radius = std::max(glm::length(maximum - minimum) * 0.5f, 1e-3f);
+
+		Mesh floatMesh, packedMesh;
+		MeshQuantizationError error;
+		createMesh(data, attributes, floatMesh);
+		createMesh(data, attributes, packedMesh, true, &error);
+
+		std::vector<unsigned char> floatPixels, packedPixels;
+		renderForComparison(floatMesh, center, radius, shading, texture, size, floatPixels);
+		renderForComparison(packedMesh, center, radius, shading, texture, size, packedPixels);
+		int differing = 0, visible = 0, maxDifference = 0;
+		for ( size_t p=0; p<floatPixels.size(); p+=4 ){
+			int difference = 0;
+			for ( int c=0; c<3; c++ )
+				difference = std::max(difference, abs((int)floatPixels[p+c] - (int)packedPixels[p+c]));
+			if ( difference > 0 )
+				differing++;
+			if ( difference > 16 )
+				visible++;
+			maxDifference = std::max(maxDifference, difference);
+		}
+
+		unsigned int floatSize = data.vertexCount * floatMesh.vertexSize;
+		unsigned int packedSize = data.vertexCount * packedMesh.vertexSize;
+		floatBytes += floatSize;
+		packedBytes += packedSize;
+		printf("%-26s %8u %10.1f %10.1f %11.6f %10.4f %10.6f %7d/%-6d %9d %9d\n",
+			paths[i], data.vertexCount, floatSize / 1024.0, packedSize / 1024.0,
+			error.position, error.normal, error.uv, differing, size * size, visible, maxDifference);
+
+		deleteMesh(floatMesh);
+		deleteMesh(packedMesh);
+		releaseMeshData(data);
+	}
+	printf("vertex memory : %.1f KB float, %.1f KB packed, %.1f KB saved\n",
+		floatBytes / 1024.0, packedBytes / 1024.0, (floatBytes - packedBytes) / 1024.0);
+
+	glDeleteTextures(1, &texture.texture);
+	resetGLState();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &colorbuffer);
+	glDeleteRenderbuffers(1, &depthbuffer);
+	glDeleteFramebuffers(1, &framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
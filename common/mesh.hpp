@@ -0,0 +1,180 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+// Attribute and uniform locations of a shader program, looked up once.
+// -1 when the program does not use them.
+struct MeshAttributes{
+	GLint position;
+	GLint uv;
+	GLint normal;
+	GLint drawIndex;      // vertexDrawIndex, see createMeshArena
+	GLint positionOffset; // uniform PositionOffset_modelspace
+	GLint positionScale;  // uniform PositionScale_modelspace
+};
+MeshAttributes getMeshAttributes(GLuint programID);
+
+// One vertex of a Mesh's interleaved vertex buffer
+struct MeshVertex{
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+};
+
+// The compact vertex, half the size of MeshVertex :
+// position as 16-bit unsigned fractions of the mesh bounds (w is padding),
+// normal as GL_INT_2_10_10_10_REV, UV as half floats.
+struct PackedMeshVertex{
+	unsigned short position[4];
+	unsigned int normal;
+	unsigned short uv[2];
+};
+
+// Largest error of a quantized mesh against its float vertices
+struct MeshQuantizationError{
+	float position; // model units
+	float normal;   // degrees
+	float uv;
+};
+
+// A mesh on the GPU : one interleaved vertex buffer, one index buffer and
+// the vertex array object binding them to the attributes, built once.
+struct Mesh{
+	GLuint vertexArray;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	GLenum indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	std::vector<MeshChunk> chunks; // See IndexedMesh
+	std::vector<MeshLod> lods; // At least one : the full mesh
+	glm::vec3 boundsMin; // Bounding box, in model space
+	glm::vec3 boundsMax;
+	glm::vec3 boundsCenter; // Bounding sphere, in model space
+	float boundsRadius;
+	unsigned int vertexSize; // sizeof(MeshVertex) or sizeof(PackedMeshVertex)
+	// The vertex shader computes positionOffset + positionScale * position.
+	// (0, 0, 0) and (1, 1, 1) for float vertices.
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+	GLint positionOffsetID;
+	GLint positionScaleID;
+	// Where createMeshArena copied the mesh, arenaVertexArray 0 when it did not
+	GLuint arenaVertexArray;
+	GLuint arenaDepthVertexArray; // MeshArena::depthVertexArray
+	unsigned int arenaBaseVertex;
+	unsigned int arenaFirstIndex;
+};
+
+// Uploads an IndexedMesh. GL thread only; the IndexedMesh can be released afterwards.
+// With quantize, the vertices are stored as PackedMeshVertex, and error
+// (when not NULL) receives how far they are from the float ones.
+void createMesh(const IndexedMesh & data, const MeshAttributes & attributes, Mesh & mesh,
+	bool quantize = false, MeshQuantizationError * error = NULL);
+
+// Binds the vertex array and draws one level of detail (clamped to the
+// coarsest), or every chunk of a split mesh.
+// Sets the position dequantization uniforms, the mesh's program must be in use.
+void drawMesh(const Mesh & mesh, unsigned int lod = 0);
+// The same with the uniform locations of another program than the one the
+// mesh was created with (the vertex attribute locations must match)
+void drawMesh(const Mesh & mesh, unsigned int lod, const MeshAttributes & attributes);
+
+// Picks the coarsest level of detail whose simplification error, projected
+// at the distance of the mesh's bounds, covers less than pixelError pixels
+// of a viewport viewportHeight pixels high. Works with perspective and
+// orthographic projections; 0 when the camera is inside the bounds.
+unsigned int selectMeshLod(
+	const Mesh & mesh,
+	const glm::mat4 & ProjectionMatrix,
+	const glm::mat4 & ViewMatrix,
+	const glm::mat4 & ModelMatrix,
+	float viewportHeight,
+	float pixelError = 1.0f
+);
+
+// What drawMesh submitted since the last reset
+struct MeshDrawStats{
+	unsigned long long triangles;
+	unsigned long long fullDetailTriangles; // The triangles at level of detail 0
+};
+extern MeshDrawStats meshDrawStats;
+
+void deleteMesh(Mesh & mesh);
+
+// Meshes that never move relative to each other, transformed at load time
+// into one vertex buffer and one index buffer. Each part is still a Mesh of
+// its own, drawing its range of the shared buffers with its own texture and
+// lights : the same vertex array for all of them, one slot of a MeshArena,
+// and one glMultiDrawElementsIndirect. Every level of detail holds every
+// part, so merged draws the whole batch at one level.
+struct StaticBatch{
+	Mesh merged; // Owns the buffers and the vertex array
+	std::vector<Mesh> parts;
+};
+
+// Moves the vertices of every mesh by its transform (normals by its inverse
+// transpose) into the model space of the batch, and uploads them like
+// createMesh. Split meshes are merged too, with 32-bit indices when the
+// batch has more than 65536 vertices. GL thread only; the IndexedMeshes can
+// be released afterwards.
+void createStaticBatch(const IndexedMesh * const * meshes, const glm::mat4 * transforms, int count,
+	const MeshAttributes & attributes, StaticBatch & batch, bool quantize = false);
+// The parts share the buffers : never pass one to deleteMesh
+void deleteStaticBatch(StaticBatch & batch);
+
+// Static meshes copied into one vertex buffer and one 16-bit index buffer
+// behind one vertex array, so that glMultiDrawElementsIndirect draws them
+// together. The meshes keep their own buffers.
+struct MeshArena{
+	GLuint vertexArray;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLuint drawIndexBuffer; // 0, 1, 2... one per instance, 0 when not used
+	// The positions alone, packed, and the vertex array reading them with the
+	// same indices and draw indices : the vertex stream of a depth pre-pass
+	GLuint positionBuffer;
+	GLuint depthVertexArray;
+	unsigned int vertexSize;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int meshCount;
+};
+
+// Copies (buffer to buffer, on the GPU) the meshes with the vertex format of
+// the first one and 16-bit indices, and records where in the meshes; the
+// others are left out. Copies of a mesh share the space of the first.
+// With drawIndices, the attribute vertexDrawIndex is the instance, 0 to
+// drawIndices - 1 : a draw with base instance i reads i.
+// The positions are read back once to build depthVertexArray.
+// The meshes must be drawn before deleteMeshArena.
+void createMeshArena(MeshArena & arena, Mesh * const * meshes, int count, const MeshAttributes & attributes, unsigned int drawIndices);
+void deleteMeshArena(MeshArena & arena);
+
+// One draw of glMultiDrawElementsIndirect, as the GL reads it
+struct MeshDrawCommand{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Appends the commands drawing a mesh of the arena like drawMesh does (one
+// per chunk of a split mesh), one instance from baseInstance, and returns
+// how many.
+unsigned int addMeshDrawCommands(const Mesh & mesh, unsigned int lod, unsigned int baseInstance, std::vector<MeshDrawCommand> & commands);
+
+// Draws the meshes for a number of frames through the previous path (separate
+// position, UV and normal buffers, rebound and looked up for every draw) and
+// through Mesh, and prints the GL calls and CPU time per frame of both. The
+// meshes are loaded with the loadIndexedOBJ flags.
+void benchmarkMeshBinding(const char * const * paths, int count, unsigned int flags, GLuint programID);
+
+struct Shading; // See shading.hpp
+
+// Renders every mesh with float and with quantized vertices into an offscreen
+// framebuffer, and prints the quantization error, the memory saved and how
+// many pixels differ.
+void compareMeshQuantization(const char * const * paths, int count, unsigned int flags, Shading & shading);
+
+#endif
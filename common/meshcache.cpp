@@ -0,0 +1,539 @@
+#include <vector>
+#include <stdio.h>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "vboindexer.hpp"
+#include "meshoptimizer.hpp"
+#include "meshsimplifier.hpp"
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+
+// Binary mesh cache.
+// A .meshcache file is a MeshCacheHeader followed by the already-indexed
+// arrays, in this order : vertices (vec3), uvs (vec2), normals (vec3),
+// chunks (MeshChunk), lods (MeshLod), indices (ushort or uint, see indexSize).
+// Everything is stored in the byte order of the machine that wrote it; a file
+// written by another architecture fails the magic check and is rebuilt.
+
+#define MESHCACHE_VERSION 4
+
+struct MeshCacheHeader{
+	char magic[4]; // "GMSH"
+	unsigned int version;
+	unsigned long long sourceSize;
+	long long sourceMtime;
+	unsigned long long sourceHash;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;
+	unsigned int chunkCount;
+	unsigned int flags; // loadIndexedOBJ flags the mesh was built with
+	float acmrBefore; // See IndexedMesh
+	float acmrAfter;
+	unsigned int lodCount;
+};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static unsigned long long payloadSize(const MeshCacheHeader & header){
+	return (unsigned long long)header.vertexCount * (sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3))
+	     + (unsigned long long)header.chunkCount * sizeof(MeshChunk)
+	     + (unsigned long long)header.lodCount * sizeof(MeshLod)
+	     + (unsigned long long)header.indexCount * header.indexSize;
+}
+
+static void resetMesh(IndexedMesh & mesh){
+	mesh.vertices = NULL;
+	mesh.uvs = NULL;
+	mesh.normals = NULL;
+	mesh.indices = NULL;
+	mesh.vertexCount = 0;
+	mesh.indexCount = 0;
+	mesh.indexSize = sizeof(unsigned short);
+	mesh.acmrBefore = 0.0f;
+	mesh.acmrAfter = 0.0f;
+	mesh.fromCache = false;
+	mesh.chunks.clear();
+	mesh.lods.clear();
+	memset(&mesh.cacheFile, 0, sizeof(MappedFile));
+}
+
+// Maps the cache file and checks it against the source OBJ.
+// On success the mesh arrays point straight into the mapping.
+static bool openMeshCache(
+	const std::string & cachePath,
+	unsigned long long sourceSize,
+	long long sourceMtime,
+	unsigned long long sourceHash,
+	unsigned int flags,
+	IndexedMesh & mesh
+){
+	MappedFile file;
+	if ( !mapFile(cachePath.c_str(), file) )
+		return false;
+
+	const MeshCacheHeader * header = (const MeshCacheHeader *)file.data;
+	if ( file.size < sizeof(MeshCacheHeader)
+	  || memcmp(header->magic, "GMSH", 4) != 0
+	  || header->version     != MESHCACHE_VERSION
+	  || header->sourceSize  != sourceSize
+	  || header->sourceMtime != sourceMtime
+	  || header->sourceHash  != sourceHash
+	  || header->flags       != flags
+	  || ( header->indexSize != sizeof(unsigned short) && header->indexSize != sizeof(unsigned int) )
+	  || file.size != sizeof(MeshCacheHeader) + payloadSize(*header)
+	){
+		unmapFile(file);
+		return false;
+	}
+
+	const unsigned char * data = file.data + sizeof(MeshCacheHeader);
+	mesh.vertexCount = header->vertexCount;
+	mesh.indexCount  = header->indexCount;
+	mesh.indexSize   = header->indexSize;
+	mesh.acmrBefore  = header->acmrBefore;
+	mesh.acmrAfter   = header->acmrAfter;
+	mesh.vertices = (const glm::vec3 *)data; data += mesh.vertexCount * sizeof(glm::vec3);
+	mesh.uvs      = (const glm::vec2 *)data; data += mesh.vertexCount * sizeof(glm::vec2);
+	mesh.normals  = (const glm::vec3 *)data; data += mesh.vertexCount * sizeof(glm::vec3);
+	const MeshChunk * chunks = (const MeshChunk *)data; data += header->chunkCount * sizeof(MeshChunk);
+	mesh.chunks.assign(chunks, chunks + header->chunkCount); // Small, and needed after releaseMeshData
+	const MeshLod * lods = (const MeshLod *)data; data += header->lodCount * sizeof(MeshLod);
+	mesh.lods.assign(lods, lods + header->lodCount);
+	mesh.indices  = data;
+	mesh.fromCache = true;
+	mesh.cacheFile = file;
+	return true;
+}
+
+static bool writeMeshCache(
+	const std::string & cachePath,
+	unsigned long long sourceSize,
+	long long sourceMtime,
+	unsigned long long sourceHash,
+	unsigned int flags,
+	const IndexedMesh & mesh
+){
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "GMSH", 4);
+	header.version     = MESHCACHE_VERSION;
+	header.sourceSize  = sourceSize;
+	header.sourceMtime = sourceMtime;
+	header.sourceHash  = sourceHash;
+	header.vertexCount = mesh.vertexCount;
+	header.indexCount  = mesh.indexCount;
+	header.indexSize   = mesh.indexSize;
+	header.chunkCount  = (unsigned int)mesh.chunks.size();
+	header.lodCount    = (unsigned int)mesh.lods.size();
+	header.flags       = flags;
+	header.acmrBefore  = mesh.acmrBefore;
+	header.acmrAfter   = mesh.acmrAfter;
+
+	// Write to a temporary file and rename it, so that a crash or a second
+	// instance never sees a half-written cache.
+	std::string tempPath = cachePath + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if ( file == NULL ){
+		printf("Could not write mesh cache %s\n", cachePath.c_str());
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if ( mesh.vertexCount > 0 ){
+		ok = ok && fwrite(mesh.vertices, sizeof(glm::vec3), mesh.vertexCount, file) == mesh.vertexCount;
+		ok = ok && fwrite(mesh.uvs,      sizeof(glm::vec2), mesh.vertexCount, file) == mesh.vertexCount;
+		ok = ok && fwrite(mesh.normals,  sizeof(glm::vec3), mesh.vertexCount, file) == mesh.vertexCount;
+	}
+	if ( !mesh.chunks.empty() )
+		ok = ok && fwrite(mesh.chunks.data(), sizeof(MeshChunk), mesh.chunks.size(), file) == mesh.chunks.size();
+	if ( !mesh.lods.empty() )
+		ok = ok && fwrite(mesh.lods.data(), sizeof(MeshLod), mesh.lods.size(), file) == mesh.lods.size();
+	if ( mesh.indexCount > 0 )
+		ok = ok && fwrite(mesh.indices, mesh.indexSize, mesh.indexCount, file) == mesh.indexCount;
+	ok = (fclose(file) == 0) && ok;
+
+	if ( ok ){
+		remove(cachePath.c_str()); // rename() does not replace existing files on Windows
+		ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+	if ( !ok ){
+		remove(tempPath.c_str());
+		printf("Could not write mesh cache %s\n", cachePath.c_str());
+	}
+	return ok;
+}
+
+// Rebuilds the owned arrays as consecutive chunks of at most 65536 vertices,
+// each with 16-bit indices relative to the start of its chunk. Triangles keep
+// their order; vertices shared by two chunks are duplicated.
+static void splitInto16BitChunks(IndexedMesh & mesh){
+	const unsigned int maxChunkVertices = 65536;
+	const unsigned int noChunk = 0xFFFFFFFF;
+
+	std::vector<unsigned int> chunkOf(mesh.ownedVertices.size(), noChunk); // Last chunk that used the vertex ...
+	std::vector<unsigned int> localIndex(mesh.ownedVertices.size()); // ... and its index there
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned short> indices;
+	indices.reserve(mesh.ownedIndices32.size());
+
+	const std::vector<unsigned int> & in = mesh.ownedIndices32;
+	MeshChunk chunk = {0, 0, 0};
+	unsigned int chunkId = 0;
+	for ( size_t i=0; i+2<in.size(); i+=3 ){
+		// Vertices of this triangle that are not in the current chunk yet
+		unsigned int missing = 0;
+		for ( int k=0; k<3; k++ ){
+			bool repeated = (k > 0 && in[i+k] == in[i]) || (k > 1 && in[i+k] == in[i+1]);
+			if ( chunkOf[in[i+k]] != chunkId && !repeated )
+				missing++;
+		}
+		if ( vertices.size() - chunk.baseVertex + missing > maxChunkVertices ){
+			chunk.indexCount = (unsigned int)indices.size() - chunk.firstIndex;
+			mesh.chunks.push_back(chunk);
+			chunk.firstIndex = (unsigned int)indices.size();
+			chunk.baseVertex = (unsigned int)vertices.size();
+			chunkId++;
+		}
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = in[i+k];
+			if ( chunkOf[v] != chunkId ){
+				chunkOf[v] = chunkId;
+				localIndex[v] = (unsigned int)vertices.size() - chunk.baseVertex;
+				vertices.push_back(mesh.ownedVertices[v]);
+				uvs     .push_back(mesh.ownedUvs[v]);
+				normals .push_back(mesh.ownedNormals[v]);
+			}
+			indices.push_back((unsigned short)localIndex[v]);
+		}
+	}
+	chunk.indexCount = (unsigned int)indices.size() - chunk.firstIndex;
+	mesh.chunks.push_back(chunk);
+
+	mesh.ownedVertices.swap(vertices);
+	mesh.ownedUvs.swap(uvs);
+	mesh.ownedNormals.swap(normals);
+	mesh.ownedIndices16.swap(indices);
+	std::vector<unsigned int>().swap(mesh.ownedIndices32);
+}
+
+// Simplifies the optimized full mesh into coarser levels and appends their
+// indices after its own. Each level starts again from the full mesh, so its
+// error is measured against it; the chain stops when a level would not
+// remove at least a tenth of the previous level's triangles.
+static void generateLods(IndexedMesh & mesh){
+	std::vector<unsigned int> & indices = mesh.ownedIndices32;
+	unsigned int vertexCount = (unsigned int)mesh.ownedVertices.size();
+	glm::vec3 minimum = mesh.ownedVertices.empty() ? glm::vec3(0.0f) : mesh.ownedVertices[0];
+	glm::vec3 maximum = minimum;
+	for ( size_t v=1; v<mesh.ownedVertices.size(); v++ ){
+		minimum = glm::min(minimum, mesh.ownedVertices[v]);
+		maximum = glm::max(maximum, mesh.ownedVertices[v]);
+	}
+	float maxError = glm::length(maximum - minimum) * MESH_LOD_MAX_ERROR;
+
+	MeshLod full = { 0, (unsigned int)indices.size(), 0.0f };
+	mesh.lods.push_back(full);
+	std::vector<unsigned int> fullIndices(indices);
+	for ( int level=1; level<MESH_LOD_COUNT; level++ ){
+		std::vector<unsigned int> lodIndices(fullIndices);
+		size_t target = (fullIndices.size() / 3 >> level) * 3;
+		float error = simplifyMesh(lodIndices, mesh.ownedVertices, target, maxError);
+		if ( lodIndices.size() * 10 > (size_t)mesh.lods.back().indexCount * 9 )
+			break;
+		optimizeVertexCache(lodIndices, vertexCount);
+		MeshLod lod = { (unsigned int)indices.size(), (unsigned int)lodIndices.size(), error };
+		mesh.lods.push_back(lod);
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+}
+
+// " (LODs 4544/2272/1136 triangles)", or nothing
+static std::string describeLods(const IndexedMesh & mesh){
+	if ( mesh.lods.empty() )
+		return std::string();
+	std::string text = " (LODs ";
+	char number[16];
+	for ( size_t i=0; i<mesh.lods.size(); i++ ){
+		snprintf(number, sizeof(number), i == 0 ? "%u" : "/%u", mesh.lods[i].indexCount / 3);
+		text += number;
+	}
+	return text + " triangles)";
+}
+
+// The slow path : text OBJ parsing followed by indexing.
+static bool parseAndIndexOBJ(const char * path, IndexedMesh & mesh, unsigned int flags){
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if ( !loadOBJ(path, vertices, uvs, normals) )
+		return false;
+
+	indexVBO(vertices, uvs, normals, mesh.ownedIndices32, mesh.ownedVertices, mesh.ownedUvs, mesh.ownedNormals);
+
+	// Triangle order for the post-transform cache, then vertex order for fetch
+	unsigned int vertexCount = (unsigned int)mesh.ownedVertices.size();
+	mesh.acmrBefore = computeACMR(mesh.ownedIndices32, vertexCount);
+	optimizeVertexCache(mesh.ownedIndices32, vertexCount);
+	if ( flags & MESH_OPTIMIZE_OVERDRAW )
+		optimizeOverdraw(mesh.ownedIndices32, mesh.ownedVertices);
+	mesh.acmrAfter = computeACMR(mesh.ownedIndices32, vertexCount);
+
+	// Levels of detail share the vertices, so they are generated before the
+	// vertices are reordered. A mesh split into chunks keeps only its full level.
+	if ( (flags & MESH_GENERATE_LODS) && !(vertexCount > 65536 && (flags & MESH_SPLIT_16BIT)) )
+		generateLods(mesh);
+	optimizeVertexFetch(mesh.ownedIndices32, mesh.ownedVertices, mesh.ownedUvs, mesh.ownedNormals);
+
+	// 16-bit indices whenever they are enough : half the index bandwidth
+	if ( mesh.ownedVertices.size() <= 65536 ){
+		mesh.ownedIndices16.assign(mesh.ownedIndices32.begin(), mesh.ownedIndices32.end());
+		std::vector<unsigned int>().swap(mesh.ownedIndices32);
+	}else if ( flags & MESH_SPLIT_16BIT ){
+		splitInto16BitChunks(mesh);
+	}
+
+	mesh.vertices = mesh.ownedVertices.data();
+	mesh.uvs      = mesh.ownedUvs.data();
+	mesh.normals  = mesh.ownedNormals.data();
+	mesh.vertexCount = (unsigned int)mesh.ownedVertices.size();
+	if ( mesh.ownedIndices32.empty() ){
+		mesh.indices   = mesh.ownedIndices16.data();
+		mesh.indexCount = (unsigned int)mesh.ownedIndices16.size();
+		mesh.indexSize = sizeof(unsigned short);
+	}else{
+		mesh.indices   = mesh.ownedIndices32.data();
+		mesh.indexCount = (unsigned int)mesh.ownedIndices32.size();
+		mesh.indexSize = sizeof(unsigned int);
+	}
+	mesh.fromCache = false;
+	return true;
+}
+
+bool loadIndexedOBJ(const char * path, IndexedMesh & mesh, unsigned int flags, const unsigned long long * knownHash){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	resetMesh(mesh);
+
+	std::string cachePath = std::string(path) + ".meshcache";
+
+	// Identify the source : size, mtime and a hash of its content
+	unsigned long long sourceSize;
+	long long sourceMtime;
+	unsigned long long sourceHash;
+	if ( knownHash != NULL && statFile(path, sourceSize, sourceMtime) ){
+		sourceHash = *knownHash;
+	}else{
+		MappedFile source;
+		if ( !mapFile(path, source) ){
+			// Let loadOBJ report the missing file
+			return parseAndIndexOBJ(path, mesh, flags);
+		}
+		sourceSize = source.size;
+		sourceMtime = source.mtime;
+		sourceHash = hashBytes(source.data, source.size);
+		unmapFile(source);
+	}
+
+	if ( openMeshCache(cachePath, sourceSize, sourceMtime, sourceHash, flags, mesh) ){
+		printf("Loaded %s from mesh cache in %.2f ms (ACMR %.3f, was %.3f)%s\n", path, elapsedMs(start), mesh.acmrAfter, mesh.acmrBefore, describeLods(mesh).c_str());
+		return true;
+	}
+
+	if ( !parseAndIndexOBJ(path, mesh, flags) )
+		return false;
+	writeMeshCache(cachePath, sourceSize, sourceMtime, sourceHash, flags, mesh);
+	printf("Parsed and indexed %s in %.2f ms (ACMR %.3f -> %.3f)%s\n", path, elapsedMs(start), mesh.acmrBefore, mesh.acmrAfter, describeLods(mesh).c_str());
+	return true;
+}
+
+void releaseMeshData(IndexedMesh & mesh){
+	if ( mesh.fromCache )
+		unmapFile(mesh.cacheFile);
+	std::vector<glm::vec3>().swap(mesh.ownedVertices);
+	std::vector<glm::vec2>().swap(mesh.ownedUvs);
+	std::vector<glm::vec3>().swap(mesh.ownedNormals);
+	std::vector<unsigned short>().swap(mesh.ownedIndices16);
+	std::vector<unsigned int>().swap(mesh.ownedIndices32);
+	mesh.vertices = NULL;
+	mesh.uvs = NULL;
+	mesh.normals = NULL;
+	mesh.indices = NULL;
+}
+
+// Reads one byte per page so that the lazily mapped cache is really in memory.
+static unsigned int touchPages(const void * data, unsigned long long size){
+	const unsigned char * bytes = (const unsigned char *)data;
+	unsigned int sum = 0;
+	for ( unsigned long long i = 0; i < size; i += 4096 )
+		sum += bytes[i];
+	return sum;
+}
+
+void benchmarkMeshCache(const char * const * paths, int count, unsigned int flags){
+	double totalText = 0.0;
+	double totalCache = 0.0;
+	unsigned int checksum = 0;
+
+	printf("%-28s %12s %12s %9s\n", "mesh", "OBJ (ms)", "cache (ms)", "speedup");
+	for ( int i = 0; i < count; i++ ){
+		// Make sure a valid cache exists before timing the cached path
+		IndexedMesh warm;
+		if ( !loadIndexedOBJ(paths[i], warm, flags) )
+			continue;
+		releaseMeshData(warm);
+
+		IndexedMesh text;
+		resetMesh(text);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		parseAndIndexOBJ(paths[i], text, flags);
+		double textMs = elapsedMs(start);
+		releaseMeshData(text);
+
+		IndexedMesh cached;
+		start = std::chrono::steady_clock::now();
+		loadIndexedOBJ(paths[i], cached, flags);
+		checksum += touchPages(cached.vertices, (unsigned long long)cached.vertexCount * sizeof(glm::vec3));
+		checksum += touchPages(cached.indices, (unsigned long long)cached.indexCount * cached.indexSize);
+		double cacheMs = elapsedMs(start);
+		releaseMeshData(cached);
+
+		printf("%-28s %12.2f %12.2f %8.1fx\n", paths[i], textMs, cacheMs, textMs / cacheMs);
+		totalText += textMs;
+		totalCache += cacheMs;
+	}
+	printf("%-28s %12.2f %12.2f %8.1fx (checksum %u)\n", "total", totalText, totalCache, totalText / totalCache, checksum);
+}
+
+static unsigned int meshIndex(const IndexedMesh & mesh, unsigned int i){
+	if ( mesh.indexSize == sizeof(unsigned int) )
+		return ((const unsigned int *)mesh.indices)[i];
+	return ((const unsigned short *)mesh.indices)[i];
+}
+
+// One triangle as the bytes of its three corners, for comparisons.
+static std::string triangleKey(const glm::vec3 * vertices, const glm::vec2 * uvs, const glm::vec3 * normals, const unsigned long long corners[3]){
+	std::string key;
+	for ( int k=0; k<3; k++ ){
+		key.append((const char *)&vertices[corners[k]], sizeof(glm::vec3));
+		key.append((const char *)&uvs[corners[k]], sizeof(glm::vec2));
+		key.append((const char *)&normals[corners[k]], sizeof(glm::vec3));
+	}
+	return key;
+}
+
+// True when the mesh draws the same triangles as the unindexed OBJ, with the
+// same winding. The optimization pass is free to change their order.
+static bool drawsSameTriangles(
+	const IndexedMesh & mesh,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals
+){
+	if ( mesh.indexCount != vertices.size() )
+		return false;
+
+	// An unsplit mesh is one chunk starting at vertex 0
+	std::vector<MeshChunk> chunks = mesh.chunks;
+	if ( chunks.empty() ){
+		MeshChunk whole = {0, mesh.indexCount, 0};
+		chunks.push_back(whole);
+	}
+	std::vector<std::string> drawn;
+	unsigned int corner = 0;
+	for ( size_t c=0; c<chunks.size(); c++ ){
+		if ( chunks[c].firstIndex != corner || chunks[c].indexCount % 3 != 0 )
+			return false;
+		for ( unsigned int i=0; i<chunks[c].indexCount; i+=3, corner+=3 ){
+			unsigned long long triangle[3];
+			for ( int k=0; k<3; k++ ){
+				triangle[k] = (unsigned long long)chunks[c].baseVertex + meshIndex(mesh, chunks[c].firstIndex + i + k);
+				if ( triangle[k] >= mesh.vertexCount )
+					return false;
+			}
+			drawn.push_back(triangleKey(mesh.vertices, mesh.uvs, mesh.normals, triangle));
+		}
+	}
+
+	std::vector<std::string> expected;
+	for ( unsigned long long i=0; i+2<vertices.size(); i+=3 ){
+		unsigned long long triangle[3] = {i, i + 1, i + 2};
+		expected.push_back(triangleKey(vertices.data(), uvs.data(), normals.data(), triangle));
+	}
+	std::sort(drawn.begin(), drawn.end());
+	std::sort(expected.begin(), expected.end());
+	return corner == mesh.indexCount && drawn == expected;
+}
+
+static bool checkLargeMesh(const char * path, unsigned int flags, bool fromCache,
+	const std::vector<glm::vec3> & vertices, const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals
+){
+	IndexedMesh mesh;
+	if ( !loadIndexedOBJ(path, mesh, flags) )
+		return false;
+
+	bool ok = mesh.fromCache == fromCache && drawsSameTriangles(mesh, vertices, uvs, normals);
+	if ( flags & MESH_SPLIT_16BIT ){
+		ok = ok && mesh.indexSize == sizeof(unsigned short) && mesh.chunks.size() > 1;
+		for ( size_t c=0; c<mesh.chunks.size(); c++ ){
+			unsigned int end = c + 1 < mesh.chunks.size() ? mesh.chunks[c+1].baseVertex : mesh.vertexCount;
+			ok = ok && end - mesh.chunks[c].baseVertex <= 65536;
+		}
+	}else{
+		ok = ok && mesh.indexSize == sizeof(unsigned int) && mesh.chunks.empty();
+	}
+	printf("%-24s %s : %u vertices, %u-bit indices, %u chunk(s) : %s\n",
+		flags & MESH_SPLIT_16BIT ? "split into 16-bit" : "32-bit indices", fromCache ? "cache" : "OBJ  ",
+		mesh.vertexCount, mesh.indexSize * 8, (unsigned int)mesh.chunks.size(), ok ? "ok" : "FAILED");
+	releaseMeshData(mesh);
+	return ok;
+}
+
+bool testLargeMesh(){
+	// A 330 x 330 grid : 108900 distinct vertices, each with its own UV
+	const char * path = "large_mesh_test.obj";
+	const int side = 330;
+	FILE * file = fopen(path, "w");
+	if ( file == NULL ){
+		printf("Could not write %s\n", path);
+		return false;
+	}
+	for ( int y=0; y<side; y++ )
+		for ( int x=0; x<side; x++ )
+			fprintf(file, "v %d %d 0\nvt %g %g\n", x, y, x / (float)(side - 1), y / (float)(side - 1));
+	fprintf(file, "vn 0 0 1\n");
+	for ( int y=0; y+1<side; y++ ){
+		for ( int x=0; x+1<side; x++ ){
+			int a = y * side + x + 1; // OBJ indices start at 1
+			int b = a + 1, c = a + side, d = c + 1;
+			fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, d, d);
+			fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, d, d, c, c);
+		}
+	}
+	fclose(file);
+
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	bool ok = loadOBJ(path, vertices, uvs, normals);
+
+	std::string cachePath = std::string(path) + ".meshcache";
+	remove(cachePath.c_str());
+	ok = ok && checkLargeMesh(path, 0, false, vertices, uvs, normals);
+	ok = ok && checkLargeMesh(path, 0, true, vertices, uvs, normals);
+	ok = ok && checkLargeMesh(path, MESH_SPLIT_16BIT, false, vertices, uvs, normals);
+	ok = ok && checkLargeMesh(path, MESH_SPLIT_16BIT, true, vertices, uvs, normals);
+
+	remove(cachePath.c_str());
+	remove(path);
+	printf("Large mesh test %s\n", ok ? "passed" : "FAILED");
+	return ok;
+}
@@ -0,0 +1,76 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+// Flags for loadIndexedOBJ
+#define MESH_SPLIT_16BIT 1 // Split meshes with more than 65536 vertices into chunks with 16-bit indices
+#define MESH_OPTIMIZE_OVERDRAW 2 // Sort triangle clusters to reduce overdraw, see optimizeOverdraw
+#define MESH_GENERATE_LODS 4 // Append simplified levels of detail to the index buffer, see simplifyMesh
+
+// Levels of detail generated with MESH_GENERATE_LODS, each half the triangles of the previous one at most
+#define MESH_LOD_COUNT 4
+// Largest simplification error allowed, as a fraction of the mesh's bounding box diagonal
+#define MESH_LOD_MAX_ERROR 0.05f
+
+// A range of the index buffer whose indices are relative to baseVertex.
+// Drawn with glDrawElementsBaseVertex.
+struct MeshChunk{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int baseVertex;
+};
+
+// A range of the index buffer drawing the whole mesh at one level of detail.
+// error is how far the simplified surface is from the full one, in model units.
+struct MeshLod{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+};
+
+// An indexed mesh, ready for glBufferData.
+// The arrays point either into a memory-mapped .meshcache file or into the
+// owned vectors below, so an IndexedMesh must not be copied once loaded.
+struct IndexedMesh{
+	const glm::vec3 * vertices;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+	const void * indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize; // 2 (unsigned short) when every index fits, 4 (unsigned int) otherwise
+	float acmrBefore; // Average cache miss ratio in the OBJ's triangle order ...
+	float acmrAfter; // ... and after the mesh optimization pass
+	bool fromCache;
+	std::vector<MeshChunk> chunks; // Empty unless the mesh was split
+	std::vector<MeshLod> lods; // Empty unless MESH_GENERATE_LODS; lods[0] is the full mesh
+
+	std::vector<glm::vec3> ownedVertices;
+	std::vector<glm::vec2> ownedUvs;
+	std::vector<glm::vec3> ownedNormals;
+	std::vector<unsigned short> ownedIndices16;
+	std::vector<unsigned int> ownedIndices32;
+	MappedFile cacheFile;
+};
+
+// Loads an OBJ through its binary cache (path + ".meshcache").
+// When the cache is missing, or was written for a different version of the
+// OBJ (size, mtime or content hash) or with other flags, the OBJ is parsed
+// with loadOBJ + indexVBO, optimized (see meshoptimizer.hpp) and a fresh
+// cache file is written next to it. knownHash, when not NULL, is the
+// hashBytes of the OBJ the caller computed already (ResourceKey::hash) : the
+// OBJ is then only read when the cache has to be rebuilt.
+bool loadIndexedOBJ(const char * path, IndexedMesh & mesh, unsigned int flags = 0, const unsigned long long * knownHash = NULL);
+
+// Drops the CPU-side arrays once they are in GL buffers. The counts stay valid.
+void releaseMeshData(IndexedMesh & mesh);
+
+// Loads every OBJ through the text path and through the cache path and prints both timings.
+// flags are the game's, so that the caches it leaves are the ones the game reads.
+void benchmarkMeshCache(const char * const * paths, int count, unsigned int flags);
+
+// Writes a synthetic OBJ with more than 100k vertices and checks that it
+// loads with 32-bit indices, and with MESH_SPLIT_16BIT into 16-bit chunks,
+// both times drawing the same triangles as the OBJ. Returns false on failure.
+bool testLargeMesh();
+
+#endif
@@ -0,0 +1,262 @@
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "vboindexer.hpp"
+#include "meshoptimizer.hpp"
+
+float computeACMR(const std::vector<unsigned int> & indices, unsigned int vertexCount, unsigned int cacheSize){
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return 0.0f;
+
+	// cachedAt[v] : value of the miss counter when v entered the FIFO.
+	// v is still in the cache while fewer than cacheSize misses happened since.
+	std::vector<unsigned int> cachedAt(vertexCount, 0);
+	unsigned int misses = 0;
+	for ( size_t i=0; i<triangleCount*3; i++ ){
+		unsigned int v = indices[i];
+		if ( cachedAt[v] == 0 || misses - cachedAt[v] >= cacheSize ){
+			misses++;
+			cachedAt[v] = misses;
+		}
+	}
+	return (float)misses / triangleCount;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, unsigned int vertexCount, unsigned int cacheSize){
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 || vertexCount == 0 )
+		return;
+
+	// Vertex -> triangle adjacency, as offsets into one array
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for ( size_t i=0; i<triangleCount*3; i++ )
+		liveTriangles[indices[i]]++;
+	std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for ( unsigned int v=0; v<vertexCount; v++ )
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(adjacencyStart[vertexCount]);
+	{
+		std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for ( size_t i=0; i<triangleCount*3; i++ )
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd; // Recently used vertices, to restart from when a fan is done
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0; // For the last resort : next vertex in input order
+	int fan = 0;
+	while ( fan >= 0 ){
+		candidates.clear();
+
+		// Emit every triangle around the fanning vertex
+		for ( unsigned int a=adjacencyStart[fan]; a<adjacencyStart[fan + 1]; a++ ){
+			unsigned int triangle = adjacency[a];
+			if ( emitted[triangle] )
+				continue;
+			for ( int k=0; k<3; k++ ){
+				unsigned int v = indices[triangle * 3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if ( time - cacheTime[v] > cacheSize ) // Not in the cache : it is now
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// Next fanning vertex : among the 1-ring, the one that will still be in
+		// the cache after its own fan, the oldest such one first
+		fan = -1;
+		int bestPriority = -1;
+		for ( size_t c=0; c<candidates.size(); c++ ){
+			unsigned int v = candidates[c];
+			if ( liveTriangles[v] == 0 )
+				continue;
+			int priority = 0;
+			if ( time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize )
+				priority = time - cacheTime[v];
+			if ( priority > bestPriority ){
+				bestPriority = priority;
+				fan = (int)v;
+			}
+		}
+
+		// Dead end : the most recent vertex that still has triangles, else the next one in input order
+		while ( fan < 0 && !deadEnd.empty() ){
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if ( liveTriangles[v] > 0 )
+				fan = (int)v;
+		}
+		while ( fan < 0 && cursor < vertexCount ){
+			if ( liveTriangles[cursor] > 0 )
+				fan = (int)cursor;
+			cursor++;
+		}
+	}
+
+	// Indices past the last whole triangle are left alone
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+struct TriangleCluster{
+	size_t firstIndex;
+	size_t indexCount;
+	float sortKey;
+};
+
+static bool drawClusterFirst(const TriangleCluster & a, const TriangleCluster & b){
+	return a.sortKey > b.sortKey;
+}
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, unsigned int cacheSize){
+	const size_t minClusterTriangles = 32; // Shorter clusters would cost more cache misses than they save in overdraw
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount <= minClusterTriangles )
+		return;
+
+	// Cluster boundaries : triangles whose three vertices all miss the FIFO
+	// cache anyway, so reordering from there on keeps the ACMR
+	std::vector<TriangleCluster> clusters;
+	std::vector<unsigned int> cachedAt(vertices.size(), 0);
+	unsigned int misses = 0;
+	TriangleCluster cluster = {0, 0, 0.0f};
+	for ( size_t t=0; t<triangleCount; t++ ){
+		int triangleMisses = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[t * 3 + k];
+			if ( cachedAt[v] == 0 || misses - cachedAt[v] >= cacheSize ){
+				misses++;
+				cachedAt[v] = misses;
+				triangleMisses++;
+			}
+		}
+		if ( triangleMisses == 3 && t * 3 - cluster.firstIndex >= minClusterTriangles * 3 ){
+			cluster.indexCount = t * 3 - cluster.firstIndex;
+			clusters.push_back(cluster);
+			cluster.firstIndex = t * 3;
+		}
+	}
+	cluster.indexCount = triangleCount * 3 - cluster.firstIndex;
+	clusters.push_back(cluster);
+	if ( clusters.size() == 1 )
+		return;
+
+	// Sort key : how far the cluster faces out of the mesh,
+	// dot(cluster centroid - mesh centroid, cluster normal), area weighted
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroids(clusters.size());
+	std::vector<glm::vec3> clusterNormals(clusters.size());
+	for ( size_t c=0; c<clusters.size(); c++ ){
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for ( size_t i=clusters[c].firstIndex; i<clusters[c].firstIndex + clusters[c].indexCount; i+=3 ){
+			const glm::vec3 & p0 = vertices[indices[i]];
+			const glm::vec3 & p1 = vertices[indices[i + 1]];
+			const glm::vec3 & p2 = vertices[indices[i + 2]];
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+			float triangleArea = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0.0f ? centroid / area : centroid;
+		clusterNormals[c] = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : normal;
+	}
+	if ( meshArea > 0.0f )
+		meshCentroid /= meshArea;
+	for ( size_t c=0; c<clusters.size(); c++ )
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+	std::stable_sort(clusters.begin(), clusters.end(), drawClusterFirst);
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for ( size_t c=0; c<clusters.size(); c++ )
+		sorted.insert(sorted.end(), indices.begin() + clusters[c].firstIndex, indices.begin() + clusters[c].firstIndex + clusters[c].indexCount);
+	std::copy(sorted.begin(), sorted.end(), indices.begin());
+}
+
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	const unsigned int unused = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<glm::vec3> newVertices;
+	std::vector<glm::vec2> newUvs;
+	std::vector<glm::vec3> newNormals;
+	newVertices.reserve(vertices.size());
+	newUvs.reserve(uvs.size());
+	newNormals.reserve(normals.size());
+
+	for ( size_t i=0; i<indices.size(); i++ ){
+		unsigned int v = indices[i];
+		if ( remap[v] == unused ){
+			remap[v] = (unsigned int)newVertices.size();
+			newVertices.push_back(vertices[v]);
+			newUvs     .push_back(uvs[v]);
+			newNormals .push_back(normals[v]);
+		}
+		indices[i] = remap[v];
+	}
+	vertices.swap(newVertices);
+	uvs.swap(newUvs);
+	normals.swap(newNormals);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkMeshOptimizer(const char * const * paths, int count){
+	printf("FIFO cache of %d vertices\n", VERTEX_CACHE_SIZE);
+	printf("%-28s %9s %9s %9s %10s %10s\n", "mesh", "triangles", "indexed", "tipsify", "+overdraw", "time (ms)");
+	double totalBefore = 0.0, totalAfter = 0.0, totalTriangles = 0.0;
+	for ( int i=0; i<count; i++ ){
+		std::vector<glm::vec3> vertices, indexedVertices, indexedNormals, normals;
+		std::vector<glm::vec2> uvs, indexedUvs;
+		std::vector<unsigned int> indices;
+		if ( !loadOBJ(paths[i], vertices, uvs, normals) )
+			continue;
+		indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUvs, indexedNormals);
+		unsigned int vertexCount = (unsigned int)indexedVertices.size();
+
+		float before = computeACMR(indices, vertexCount);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		optimizeVertexCache(indices, vertexCount);
+		float afterCache = computeACMR(indices, vertexCount);
+		optimizeOverdraw(indices, indexedVertices);
+		optimizeVertexFetch(indices, indexedVertices, indexedUvs, indexedNormals);
+		double ms = elapsedMs(start);
+		float after = computeACMR(indices, vertexCount);
+
+		size_t triangles = indices.size() / 3;
+		printf("%-28s %9u %9.3f %9.3f %10.3f %10.2f\n", paths[i], (unsigned int)triangles, before, afterCache, after, ms);
+		totalBefore += before * triangles;
+		totalAfter += after * triangles;
+		totalTriangles += triangles;
+	}
+	if ( totalTriangles > 0 )
+		printf("%-28s %9u %9.3f %9s %10.3f\n", "all (triangle weighted)", (unsigned int)totalTriangles,
+			totalBefore / totalTriangles, "", totalAfter / totalTriangles);
+}
@@ -0,0 +1,34 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+// Entries of the simulated FIFO post-transform vertex cache
+#define VERTEX_CACHE_SIZE 16
+
+// Average cache miss ratio : vertex shader invocations per triangle with a
+// FIFO cache of cacheSize entries. 3.0 is the worst possible value.
+float computeACMR(const std::vector<unsigned int> & indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for post-transform cache locality.
+// This is Tipsify (Sander, Nehab and Barczak, 2007), the algorithm behind
+// assimp's ImproveCacheLocality : fan around the vertex most likely to still
+// be in the cache, and jump through a dead-end stack when the fan is done.
+void optimizeVertexCache(std::vector<unsigned int> & indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Splits the triangle order into clusters where the cache would miss anyway,
+// then draws the clusters that face away from the centre of the mesh first,
+// so that they occlude the rest. Run after optimizeVertexCache.
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Renumbers the vertices in the order the indices first use them, so that
+// vertex fetch walks the buffer forwards. Unused vertices are dropped.
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+// Prints the ACMR of every OBJ before and after optimization.
+void benchmarkMeshOptimizer(const char * const * paths, int count);
+
+#endif
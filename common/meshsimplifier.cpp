@@ -0,0 +1,380 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "meshsimplifier.hpp"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix,
+// with the total weight of the planes to turn it into an average.
+struct Quadric{
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+	double weight;
+};
+
+static void addPlane(Quadric & q, const glm::dvec3 & n, double d, double w){
+	q.a00 += w * n.x * n.x; q.a01 += w * n.x * n.y; q.a02 += w * n.x * n.z; q.a03 += w * n.x * d;
+	q.a11 += w * n.y * n.y; q.a12 += w * n.y * n.z; q.a13 += w * n.y * d;
+	q.a22 += w * n.z * n.z; q.a23 += w * n.z * d;
+	q.a33 += w * d * d;
+	q.weight += w;
+}
+
+static void addQuadric(Quadric & q, const Quadric & r){
+	q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+	q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+	q.a22 += r.a22; q.a23 += r.a23;
+	q.a33 += r.a33;
+	q.weight += r.weight;
+}
+
+// Average squared distance from p to the planes
+static double quadricError(const Quadric & q, const glm::dvec3 & p){
+	if ( q.weight <= 0.0 )
+		return 0.0;
+	double e = q.a00 * p.x * p.x + 2.0 * q.a01 * p.x * p.y + 2.0 * q.a02 * p.x * p.z + 2.0 * q.a03 * p.x
+	         + q.a11 * p.y * p.y + 2.0 * q.a12 * p.y * p.z + 2.0 * q.a13 * p.y
+	         + q.a22 * p.z * p.z + 2.0 * q.a23 * p.z
+	         + q.a33;
+	return fabs(e) / q.weight;
+}
+
+static bool lessPosition(const glm::vec3 & a, const glm::vec3 & b){
+	if ( a.x != b.x ) return a.x < b.x;
+	if ( a.y != b.y ) return a.y < b.y;
+	return a.z < b.z;
+}
+
+// indexVBO keeps one vertex per position/UV/normal combination, so a
+// position on a seam has several vertices. positionOf maps each of them to
+// one representative vertex, which stands for the position below.
+static void weldPositions(const std::vector<glm::vec3> & vertices, std::vector<unsigned int> & positionOf){
+	std::vector<unsigned int> order(vertices.size());
+	for ( unsigned int i=0; i<order.size(); i++ )
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&vertices](unsigned int a, unsigned int b){
+		return lessPosition(vertices[a], vertices[b]);
+	});
+	positionOf.resize(vertices.size());
+	for ( size_t i=0; i<order.size(); i++ ){
+		if ( i > 0 && vertices[order[i]] == vertices[order[i-1]] )
+			positionOf[order[i]] = positionOf[order[i-1]];
+		else
+			positionOf[order[i]] = order[i];
+	}
+}
+
+// One side of a triangle edge
+struct HalfEdge{
+	unsigned int from, to;           // positions
+	unsigned int wedgeFrom, wedgeTo; // vertices
+	unsigned int triangle;
+};
+
+static bool lessEdge(const HalfEdge & a, const HalfEdge & b){
+	unsigned int a0 = std::min(a.from, a.to), a1 = std::max(a.from, a.to);
+	unsigned int b0 = std::min(b.from, b.to), b1 = std::max(b.from, b.to);
+	if ( a0 != b0 ) return a0 < b0;
+	return a1 < b1;
+}
+
+struct Collapse{
+	unsigned int from, to; // positions
+	double error;
+};
+
+static bool lessError(const Collapse & a, const Collapse & b){
+	return a.error < b.error;
+}
+
+static glm::dvec3 triangleNormal(const glm::dvec3 & a, const glm::dvec3 & b, const glm::dvec3 & c){
+	return glm::cross(b - a, c - a);
+}
+
+// Position -> triangle adjacency, as offsets into one array
+struct Adjacency{
+	std::vector<unsigned int> start;
+	std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(const std::vector<unsigned int> & indices, const std::vector<unsigned int> & positionOf, Adjacency & adjacency){
+	size_t vertexCount = positionOf.size();
+	adjacency.start.assign(vertexCount + 1, 0);
+	for ( size_t i=0; i<indices.size(); i++ )
+		adjacency.start[positionOf[indices[i]] + 1]++;
+	for ( size_t v=0; v<vertexCount; v++ )
+		adjacency.start[v + 1] += adjacency.start[v];
+	adjacency.triangles.resize(indices.size());
+	std::vector<unsigned int> fill(adjacency.start.begin(), adjacency.start.end() - 1);
+	for ( size_t i=0; i<indices.size(); i++ )
+		adjacency.triangles[fill[positionOf[indices[i]]]++] = (unsigned int)(i / 3);
+}
+
+// Checks that moving position from onto position to keeps the mesh valid,
+// and fills remap with the vertex each vertex at from becomes.
+static bool canCollapse(
+	unsigned int from,
+	unsigned int to,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<unsigned int> & positionOf,
+	const Adjacency & adjacency,
+	std::vector<std::pair<unsigned int, unsigned int> > & remap,
+	std::vector<unsigned int> & ring
+){
+	remap.clear();
+	ring.clear();
+
+	// The triangles on the edge disappear. In each of them, the vertex at
+	// from has a neighbour at to with the UV and normal it continues into.
+	for ( unsigned int a=adjacency.start[from]; a<adjacency.start[from + 1]; a++ ){
+		const unsigned int * triangle = &indices[adjacency.triangles[a] * 3];
+		unsigned int wedgeFrom = 0, wedgeTo = 0;
+		bool hasTo = false;
+		for ( int k=0; k<3; k++ ){
+			unsigned int position = positionOf[triangle[k]];
+			if ( position == from )
+				wedgeFrom = triangle[k];
+			else if ( position == to ){
+				wedgeTo = triangle[k];
+				hasTo = true;
+			}
+			if ( position != from )
+				ring.push_back(position);
+		}
+		if ( !hasTo )
+			continue;
+		bool known = false;
+		for ( size_t r=0; r<remap.size(); r++ ){
+			if ( remap[r].first == wedgeFrom ){
+				if ( remap[r].second != wedgeTo )
+					return false; // The edge crosses a seam at to
+				known = true;
+			}
+		}
+		if ( !known )
+			remap.push_back(std::make_pair(wedgeFrom, wedgeTo));
+	}
+
+	// The other triangles around from get the vertex at to instead : it must
+	// exist for their side of any seam, and they must not fold over.
+	glm::dvec3 target = glm::dvec3(vertices[to]);
+	for ( unsigned int a=adjacency.start[from]; a<adjacency.start[from + 1]; a++ ){
+		const unsigned int * triangle = &indices[adjacency.triangles[a] * 3];
+		glm::dvec3 corners[3], moved[3];
+		bool hasTo = false;
+		unsigned int wedgeFrom = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int position = positionOf[triangle[k]];
+			corners[k] = moved[k] = glm::dvec3(vertices[position]);
+			if ( position == from ){
+				wedgeFrom = triangle[k];
+				moved[k] = target;
+			}
+			hasTo = hasTo || position == to;
+		}
+		if ( hasTo )
+			continue;
+		bool mapped = false;
+		for ( size_t r=0; r<remap.size() && !mapped; r++ )
+			mapped = remap[r].first == wedgeFrom;
+		if ( !mapped )
+			return false;
+		glm::dvec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+		glm::dvec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+		if ( glm::dot(before, after) <= 0.0 )
+			return false;
+	}
+
+	// Link condition : the edge's two triangles must be the only ones the
+	// two positions share, or the collapse pinches the surface.
+	std::sort(ring.begin(), ring.end());
+	ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+	unsigned int shared = 0;
+	std::vector<unsigned int> seen;
+	for ( unsigned int a=adjacency.start[to]; a<adjacency.start[to + 1]; a++ ){
+		const unsigned int * triangle = &indices[adjacency.triangles[a] * 3];
+		for ( int k=0; k<3; k++ ){
+			unsigned int position = positionOf[triangle[k]];
+			if ( position == to || position == from )
+				continue;
+			if ( std::binary_search(ring.begin(), ring.end(), position)
+			  && std::find(seen.begin(), seen.end(), position) == seen.end() ){
+				seen.push_back(position);
+				shared++;
+			}
+		}
+	}
+	return shared == 2;
+}
+
+float simplifyMesh(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	size_t targetIndexCount,
+	float maxError
+){
+	size_t vertexCount = vertices.size();
+	std::vector<unsigned int> positionOf;
+	weldPositions(vertices, positionOf);
+
+	// Triangles with two corners at the same position cover nothing
+	{
+		size_t kept = 0;
+		for ( size_t i=0; i+2<indices.size(); i+=3 ){
+			unsigned int a = positionOf[indices[i]], b = positionOf[indices[i+1]], c = positionOf[indices[i+2]];
+			if ( a == b || b == c || a == c )
+				continue;
+			indices[kept++] = indices[i];
+			indices[kept++] = indices[i+1];
+			indices[kept++] = indices[i+2];
+		}
+		indices.resize(kept);
+	}
+
+	// Each position starts with the planes of its triangles, weighted by area
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	std::vector<Quadric> quadrics(vertexCount, zero);
+	for ( size_t i=0; i<indices.size(); i+=3 ){
+		glm::dvec3 p0 = glm::dvec3(vertices[indices[i]]);
+		glm::dvec3 p1 = glm::dvec3(vertices[indices[i+1]]);
+		glm::dvec3 p2 = glm::dvec3(vertices[indices[i+2]]);
+		glm::dvec3 normal = triangleNormal(p0, p1, p2);
+		double area = glm::length(normal) * 0.5;
+		if ( area <= 0.0 )
+			continue;
+		normal = glm::normalize(normal);
+		for ( int k=0; k<3; k++ )
+			addPlane(quadrics[positionOf[indices[i+k]]], normal, -glm::dot(normal, p0), area);
+	}
+
+	// Edges used by one triangle are borders, by more than two or twice in
+	// the same direction non-manifold : their positions stay where they are.
+	// Seam edges get planes across them, which keep the seam line in shape.
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::vector<HalfEdge> edges;
+		edges.reserve(indices.size());
+		for ( size_t i=0; i<indices.size(); i+=3 ){
+			for ( int k=0; k<3; k++ ){
+				HalfEdge edge;
+				edge.wedgeFrom = indices[i + k];
+				edge.wedgeTo = indices[i + (k + 1) % 3];
+				edge.from = positionOf[edge.wedgeFrom];
+				edge.to = positionOf[edge.wedgeTo];
+				edge.triangle = (unsigned int)(i / 3);
+				edges.push_back(edge);
+			}
+		}
+		std::sort(edges.begin(), edges.end(), lessEdge);
+		for ( size_t first=0, last; first<edges.size(); first=last ){
+			last = first + 1;
+			while ( last < edges.size() && !lessEdge(edges[first], edges[last]) )
+				last++;
+			const HalfEdge & a = edges[first];
+			const HalfEdge & b = edges[first + 1];
+			if ( last - first != 2 || a.from != b.to ){
+				locked[a.from] = true;
+				locked[a.to] = true;
+				continue;
+			}
+			if ( a.wedgeFrom == b.wedgeTo && a.wedgeTo == b.wedgeFrom )
+				continue;
+			for ( size_t e=first; e<last; e++ ){
+				const unsigned int * triangle = &indices[edges[e].triangle * 3];
+				glm::dvec3 p0 = glm::dvec3(vertices[triangle[0]]);
+				glm::dvec3 normal = triangleNormal(p0, glm::dvec3(vertices[triangle[1]]), glm::dvec3(vertices[triangle[2]]));
+				glm::dvec3 from = glm::dvec3(vertices[edges[e].from]);
+				glm::dvec3 along = glm::dvec3(vertices[edges[e].to]) - from;
+				glm::dvec3 across = glm::cross(along, normal);
+				if ( glm::length(across) <= 0.0 )
+					continue;
+				across = glm::normalize(across);
+				double weight = glm::dot(along, along);
+				addPlane(quadrics[edges[e].from], across, -glm::dot(across, from), weight);
+				addPlane(quadrics[edges[e].to], across, -glm::dot(across, from), weight);
+			}
+		}
+	}
+
+	double maxCost = (double)maxError * maxError;
+	double resultCost = 0.0;
+	Adjacency adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> wedgeRemap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<std::pair<unsigned int, unsigned int> > remap;
+	std::vector<unsigned int> ring;
+
+	// Each pass collapses the cheapest edges whose neighbourhoods do not
+	// overlap, then rebuilds the index buffer
+	while ( indices.size() > targetIndexCount ){
+		buildAdjacency(indices, positionOf, adjacency);
+
+		// Both directions of every edge, listed once from the triangle where from < to
+		collapses.clear();
+		for ( size_t i=0; i<indices.size(); i+=3 ){
+			for ( int k=0; k<3; k++ ){
+				unsigned int a = positionOf[indices[i + k]];
+				unsigned int b = positionOf[indices[i + (k + 1) % 3]];
+				if ( a > b )
+					continue;
+				if ( !locked[a] ){
+					Collapse collapse = { a, b, quadricError(quadrics[a], glm::dvec3(vertices[b])) };
+					collapses.push_back(collapse);
+				}
+				if ( !locked[b] ){
+					Collapse collapse = { b, a, quadricError(quadrics[b], glm::dvec3(vertices[a])) };
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), lessError);
+
+		// A collapse removes two triangles
+		size_t collapseLimit = (indices.size() - targetIndexCount + 5) / 6;
+		size_t collapsed = 0;
+		for ( size_t v=0; v<vertexCount; v++ ){
+			wedgeRemap[v] = (unsigned int)v;
+			touched[v] = false;
+		}
+		for ( size_t c=0; c<collapses.size() && collapsed<collapseLimit; c++ ){
+			const Collapse & collapse = collapses[c];
+			if ( collapse.error > maxCost )
+				break;
+			if ( touched[collapse.from] || touched[collapse.to] )
+				continue;
+			if ( !canCollapse(collapse.from, collapse.to, indices, vertices, positionOf, adjacency, remap, ring) )
+				continue;
+
+			for ( size_t r=0; r<remap.size(); r++ )
+				wedgeRemap[remap[r].first] = remap[r].second;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			touched[collapse.from] = true;
+			for ( size_t r=0; r<ring.size(); r++ )
+				touched[ring[r]] = true;
+			resultCost = std::max(resultCost, collapse.error);
+			collapsed++;
+		}
+		if ( collapsed == 0 )
+			break;
+
+		size_t kept = 0;
+		for ( size_t i=0; i<indices.size(); i+=3 ){
+			unsigned int a = wedgeRemap[indices[i]], b = wedgeRemap[indices[i+1]], c = wedgeRemap[indices[i+2]];
+			if ( positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[a] == positionOf[c] )
+				continue;
+			indices[kept++] = a;
+			indices[kept++] = b;
+			indices[kept++] = c;
+		}
+		indices.resize(kept);
+	}
+	return (float)sqrt(resultCost);
+}
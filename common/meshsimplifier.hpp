@@ -0,0 +1,19 @@
+#ifndef MESHSIMPLIFIER_HPP
+#define MESHSIMPLIFIER_HPP
+
+// Removes triangles by collapsing edges in the order of their quadric error
+// (Garland and Heckbert, 1997), until at most targetIndexCount indices are
+// left or the next collapse would move the surface more than maxError.
+// A collapse moves a vertex onto a neighbour and takes that neighbour's
+// UV and normal, so the result indexes the same vertex buffer. Vertices on
+// an open border or a non-manifold edge never move, and a vertex on a UV or
+// normal seam only moves along the seam.
+// Returns the largest error of the collapses done, in model units.
+float simplifyMesh(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	size_t targetIndexCount,
+	float maxError
+);
+
+#endif
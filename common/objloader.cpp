@@ -1,10 +1,15 @@
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 
 #include <glm/glm.hpp>
 
+#include "mappedfile.hpp"
 #include "objloader.hpp"
 
 // Very, VERY simple OBJ loader.
@@ -17,7 +22,7 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
+bool loadOBJ_slow(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs,
@@ -111,6 +116,412 @@ bool loadOBJ(
 }
 
 
+// Same output as loadOBJ_slow, without fscanf.
+// The file is memory-mapped and read twice : the first pass counts the
+// v/vt/vn/f records so that every vector is reserved exactly once, the second
+// pass parses numbers in place, without scanf, locales or temporary strings.
+// On top of v/vt/vn faces it accepts the v, v/vt and v//vn forms, polygons
+// (split as fans) and negative (relative) indices. Faces without normals get
+// their flat face normal, faces without UVs get (0,0).
+
+struct OBJCorner{
+	int vertex, uv, normal; // 0-based, -1 if absent
+};
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while ( p < end && isBlank(*p) )
+		p++;
+	return p;
+}
+
+static inline const char * nextLine(const char * p, const char * end){
+	const char * eol = (const char *)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+static inline bool atEndOfLine(const char * p, const char * end){
+	return p >= end || *p == '\n' || *p == '#';
+}
+
+// Digit runs are read 8 bytes at a time (SWAR) when there is room for a
+// full word, which avoids one mispredicted loop exit per number.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define OBJ_SWAR_DIGITS 0
+#else
+#define OBJ_SWAR_DIGITS 1
+#endif
+
+#if OBJ_SWAR_DIGITS
+static inline int countTrailingZeros(unsigned long long value){
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+// Number of ASCII digits at the start of the 8 bytes in word
+static inline int leadingDigits(unsigned long long word){
+	// The high bit of a byte is set for non-digits. A borrow can only corrupt
+	// the bytes after the first non-digit, which are never looked at.
+	unsigned long long nonDigits = ((word + 0x4646464646464646ULL) | (word - 0x3030303030303030ULL)) & 0x8080808080808080ULL;
+	return nonDigits ? countTrailingZeros(nonDigits) >> 3 : 8;
+}
+
+// Value of the first count (1..8) digits in word
+static inline unsigned int digitsValue(unsigned long long word, int count){
+	word -= 0x3030303030303030ULL;
+	// Keep the digits and move them up so the missing ones become leading zeros
+	word <<= 8 * (8 - count);
+	word = (word * 10) + (word >> 8);
+	word = (((word & 0x000000FF000000FFULL) * 0x000F424000000064ULL)
+	     + (((word >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+	return (unsigned int)word;
+}
+#endif
+
+// Reads a run of decimal digits. Returns the first non-digit; value overflows
+// silently past 19 digits, callers check count.
+static inline const char * scanDigits(const char * p, const char * end, unsigned long long & value, int & count){
+	static const unsigned int powersOf10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+	value = 0;
+	count = 0;
+#if OBJ_SWAR_DIGITS
+	while ( end - p >= 8 ){
+		unsigned long long word;
+		memcpy(&word, p, 8);
+		int n = leadingDigits(word);
+		if ( n == 0 )
+			return p;
+		value = value * powersOf10[n] + digitsValue(word, n);
+		count += n;
+		p += n;
+		if ( n < 8 )
+			return p;
+	}
+#endif
+	while ( p < end && (unsigned char)(*p - '0') <= 9 ){
+		value = value * 10 + (*p - '0');
+		count++;
+		p++;
+	}
+	return p;
+}
+
+// Fast path for the plain decimals exporters write ("-0.123456").
+// When the digits fit in a float mantissa and the power of ten is exact in a
+// float, one IEEE division gives the correctly rounded value, i.e. the one strtof returns.
+static bool parseSimpleFloat(const char * & p, const char * end, float & value){
+	static const float powersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	const char * q = p;
+	bool negative = false;
+	if ( q < end && *q == '-' ){
+		negative = true;
+		q++;
+	}
+	unsigned long long integer, fraction = 0;
+	int integerDigits, fractionDigits = 0;
+	q = scanDigits(q, end, integer, integerDigits);
+	if ( q < end && *q == '.' )
+		q = scanDigits(q + 1, end, fraction, fractionDigits);
+
+	if ( integerDigits + fractionDigits == 0 || integerDigits + fractionDigits > 9 || fractionDigits > 10 )
+		return false;
+	if ( q < end && (*q == 'e' || *q == 'E') )
+		return false;
+	static const unsigned int scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+	unsigned long long mantissa = integer * scale[fractionDigits] + fraction;
+	if ( mantissa > (1u << 24) )
+		return false;
+
+	value = (float)mantissa / powersOf10[fractionDigits];
+	if ( negative )
+		value = -value;
+	p = q;
+	return true;
+}
+
+// The parsers below work on a local copy of the cursor and store it back once :
+// stepping through a char pointer held by reference would force a store and a
+// reload of the pointer for every character read.
+
+static bool parseFloat(const char * & cursor, const char * end, float & value){
+	const char * p = skipBlanks(cursor, end);
+	if ( p < end && *p == '+' )
+		p++;
+	if ( parseSimpleFloat(p, end, value) ){
+		cursor = p;
+		return true;
+	}
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if ( result.ec == std::errc::result_out_of_range ){
+		// Denormals and overflows : let strtof pick the same value scanf would
+		char buffer[64];
+		size_t length = std::min((size_t)(result.ptr - p), sizeof(buffer) - 1);
+		memcpy(buffer, p, length);
+		buffer[length] = '\0';
+		value = strtof(buffer, NULL);
+	}else if ( result.ec != std::errc() ){
+		return false;
+	}
+	cursor = result.ptr;
+	return true;
+}
+
+static bool parseInt(const char * & cursor, const char * end, int & value){
+	const char * p = cursor;
+	bool negative = false;
+	if ( p < end && (*p == '-' || *p == '+') ){
+		negative = (*p == '-');
+		p++;
+	}
+	unsigned long long result;
+	int digits;
+	p = scanDigits(p, end, result, digits);
+	if ( digits == 0 || digits > 9 )
+		return false;
+	value = negative ? -(int)result : (int)result;
+	cursor = p;
+	return true;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element read so far.
+static inline int resolveIndex(int index, size_t count){
+	return index < 0 ? (int)count + index : index - 1;
+}
+
+// Parses one "v", "v/vt", "v//vn" or "v/vt/vn" face corner
+static bool parseCorner(const char * & cursor, const char * end, size_t vertexCount, size_t uvCount, size_t normalCount, OBJCorner & corner){
+	const char * p = cursor;
+	int index;
+	corner.uv = corner.normal = -1;
+	if ( !parseInt(p, end, index) )
+		return false;
+	corner.vertex = resolveIndex(index, vertexCount);
+	if ( p < end && *p == '/' ){
+		p++;
+		if ( p < end && *p != '/' ){
+			if ( !parseInt(p, end, index) )
+				return false;
+			corner.uv = resolveIndex(index, uvCount);
+		}
+		if ( p < end && *p == '/' ){
+			p++;
+			if ( !parseInt(p, end, index) )
+				return false;
+			corner.normal = resolveIndex(index, normalCount);
+		}
+	}
+	cursor = p;
+	return p >= end || isBlank(*p) || *p == '\n' || *p == '#';
+}
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if ( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+	const char * begin = (const char *)file.data;
+	const char * end = begin + file.size;
+
+	// First pass : count the records. Only polygons with more than 3 corners
+	// make the output arrays grow past this estimate.
+	size_t vertexCount = 0, uvCount = 0, normalCount = 0, faceCount = 0;
+	for ( const char * p = begin; p < end; p = nextLine(p, end) ){
+		p = skipBlanks(p, end);
+		if ( end - p < 2 )
+			continue;
+		if ( p[0] == 'v' ){
+			if ( isBlank(p[1]) )      vertexCount++;
+			else if ( p[1] == 't' )   uvCount++;
+			else if ( p[1] == 'n' )   normalCount++;
+		}else if ( p[0] == 'f' && isBlank(p[1]) ){
+			faceCount++;
+		}
+	}
+
+	std::vector<glm::vec3> temp_vertices;
+	std::vector<glm::vec2> temp_uvs;
+	std::vector<glm::vec3> temp_normals;
+	temp_vertices.reserve(vertexCount);
+	temp_uvs.reserve(uvCount);
+	temp_normals.reserve(normalCount);
+
+	size_t base = out_vertices.size();
+	out_vertices.reserve(base + faceCount * 3);
+	out_uvs     .reserve(base + faceCount * 3);
+	out_normals .reserve(base + faceCount * 3);
+
+	// Corners are written out as soon as their face is read. Only the ones that
+	// refer to records further down the file, and the triangles that need a
+	// flat normal, are remembered and patched at the end.
+	std::vector<OBJCorner> laterCorners;
+	std::vector<size_t> laterSlots;
+	std::vector<size_t> flatTriangles;
+
+	// Second pass : parse
+	bool ok = true;
+	for ( const char * p = begin; p < end && ok; p = nextLine(p, end) ){
+		p = skipBlanks(p, end);
+		if ( end - p < 2 )
+			continue;
+		if ( p[0] == 'v' && isBlank(p[1]) ){
+			glm::vec3 vertex;
+			p += 1;
+			ok = parseFloat(p, end, vertex.x) && parseFloat(p, end, vertex.y) && parseFloat(p, end, vertex.z);
+			temp_vertices.push_back(vertex);
+		}else if ( p[0] == 'v' && p[1] == 't' ){
+			glm::vec2 uv;
+			p += 2;
+			ok = parseFloat(p, end, uv.x) && parseFloat(p, end, uv.y);
+			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			temp_uvs.push_back(uv);
+		}else if ( p[0] == 'v' && p[1] == 'n' ){
+			glm::vec3 normal;
+			p += 2;
+			ok = parseFloat(p, end, normal.x) && parseFloat(p, end, normal.y) && parseFloat(p, end, normal.z);
+			temp_normals.push_back(normal);
+		}else if ( p[0] == 'f' && isBlank(p[1]) ){
+			// Split polygons as a fan around their first corner
+			OBJCorner triangle[3];
+			int count = 0;
+			p += 1;
+			while ( ok ){
+				p = skipBlanks(p, end);
+				if ( atEndOfLine(p, end) )
+					break;
+				OBJCorner & corner = triangle[count < 2 ? count : 2];
+				ok = parseCorner(p, end, temp_vertices.size(), temp_uvs.size(), temp_normals.size(), corner);
+				count++;
+				if ( !ok || count < 3 )
+					continue;
+
+				bool needsFlatNormal = false;
+				for ( int k = 0; k < 3; k++ ){
+					const OBJCorner & c = triangle[k];
+					if ( c.vertex >= 0 && c.vertex < (int)temp_vertices.size()
+					  && c.uv < (int)temp_uvs.size()
+					  && c.normal < (int)temp_normals.size()
+					){
+						out_vertices.push_back(temp_vertices[c.vertex]);
+						out_uvs     .push_back(c.uv >= 0 ? temp_uvs[c.uv] : glm::vec2(0.0f));
+						out_normals .push_back(c.normal >= 0 ? temp_normals[c.normal] : glm::vec3(0.0f));
+					}else{
+						laterSlots.push_back(out_vertices.size());
+						laterCorners.push_back(c);
+						out_vertices.push_back(glm::vec3(0.0f));
+						out_uvs     .push_back(glm::vec2(0.0f));
+						out_normals .push_back(glm::vec3(0.0f));
+					}
+					needsFlatNormal = needsFlatNormal || c.normal < 0;
+				}
+				if ( needsFlatNormal )
+					flatTriangles.push_back(out_vertices.size() - 3);
+
+				// The next triangle of the fan starts from the first corner and this one
+				triangle[1] = triangle[2];
+			}
+			ok = ok && count >= 3;
+		}
+	}
+	unmapFile(file);
+
+	// Corners that referred to records further down the file
+	for ( size_t i = 0; i < laterCorners.size() && ok; i++ ){
+		const OBJCorner & corner = laterCorners[i];
+		size_t slot = laterSlots[i];
+		if ( corner.vertex < 0 || corner.vertex >= (int)temp_vertices.size()
+		  || corner.uv >= (int)temp_uvs.size()
+		  || corner.normal >= (int)temp_normals.size()
+		){
+			ok = false;
+			break;
+		}
+		out_vertices[slot] = temp_vertices[corner.vertex];
+		if ( corner.uv >= 0 )     out_uvs[slot]     = temp_uvs[corner.uv];
+		if ( corner.normal >= 0 ) out_normals[slot] = temp_normals[corner.normal];
+	}
+
+	if ( !ok ){
+		printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+		out_vertices.resize(base);
+		out_uvs     .resize(base);
+		out_normals .resize(base);
+		return false;
+	}
+
+	// Flat normals for the corners that had none
+	for ( size_t t = 0; t < flatTriangles.size(); t++ ){
+		size_t i = flatTriangles[t];
+		const glm::vec3 & a = out_vertices[i];
+		glm::vec3 normal = glm::cross(out_vertices[i + 1] - a, out_vertices[i + 2] - a);
+		float length = glm::length(normal);
+		normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		for ( int k = 0; k < 3; k++ ){
+			if ( out_normals[i + k] == glm::vec3(0.0f) )
+				out_normals[i + k] = normal;
+		}
+	}
+	return true;
+}
+
+// Times loadOBJ_slow against loadOBJ on each file (best of 5 runs) and checks that they agree.
+void benchmarkOBJLoader(const char * const * paths, int count){
+	const int runs = 5;
+	double totalSlow = 0.0;
+	double totalFast = 0.0;
+	for ( int i = 0; i < count; i++ ){
+		std::vector<glm::vec3> slowVertices, fastVertices, slowNormals, fastNormals;
+		std::vector<glm::vec2> slowUvs, fastUvs;
+		bool slowOk = false, fastOk = false;
+		double slowMs = 1e30, fastMs = 1e30;
+
+		for ( int run = 0; run < runs; run++ ){
+			slowVertices.clear(); slowUvs.clear(); slowNormals.clear();
+			slowVertices.shrink_to_fit(); slowUvs.shrink_to_fit(); slowNormals.shrink_to_fit();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			slowOk = loadOBJ_slow(paths[i], slowVertices, slowUvs, slowNormals);
+			slowMs = std::min(slowMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+			fastVertices.clear(); fastUvs.clear(); fastNormals.clear();
+			fastVertices.shrink_to_fit(); fastUvs.shrink_to_fit(); fastNormals.shrink_to_fit();
+			start = std::chrono::steady_clock::now();
+			fastOk = loadOBJ(paths[i], fastVertices, fastUvs, fastNormals);
+			fastMs = std::min(fastMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		bool same = slowOk == fastOk
+			&& slowVertices.size() == fastVertices.size()
+			&& slowUvs.size() == fastUvs.size()
+			&& slowNormals.size() == fastNormals.size()
+			&& memcmp(slowVertices.data(), fastVertices.data(), slowVertices.size() * sizeof(glm::vec3)) == 0
+			&& memcmp(slowUvs.data(), fastUvs.data(), slowUvs.size() * sizeof(glm::vec2)) == 0
+			&& memcmp(slowNormals.data(), fastNormals.data(), slowNormals.size() * sizeof(glm::vec3)) == 0;
+
+		printf("%-28s fscanf %8.2f ms   mmap %8.2f ms   %5.1fx   %s\n",
+			paths[i], slowMs, fastMs, slowMs / fastMs, same ? "identical" : "DIFFERENT");
+		totalSlow += slowMs;
+		totalFast += fastMs;
+	}
+	printf("%-28s fscanf %8.2f ms   mmap %8.2f ms   %5.1fx\n", "total", totalSlow, totalFast, totalSlow / totalFast);
+}
+
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
 // Include AssImp
@@ -171,4 +582,4 @@ bool loadAssImp(
 	return true;
 }
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
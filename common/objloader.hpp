@@ -8,6 +8,17 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
+// The original fscanf-based loader, kept for comparison
+bool loadOBJ_slow(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals
+);
+
+// Times loadOBJ_slow against loadOBJ on each file and checks that they agree
+void benchmarkOBJLoader(const char * const * paths, int count);
+
 
 
 bool loadAssImp(
@@ -18,4 +29,4 @@ bool loadAssImp(
 	std::vector<glm::vec3> & normals
 );
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
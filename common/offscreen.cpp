@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "offscreen.hpp"
+
+#ifdef HAVE_EGL
+
+// Whether the space separated list has the extension
+static bool hasExtension(const char * extensions, const char * name){
+	size_t length = strlen(name);
+	for ( const char * at = extensions; at && (at = strstr(at, name)) != NULL; at += length )
+		if ( (at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0') )
+			return true;
+	return false;
+}
+
+bool createOffscreenContext(OffscreenContext & offscreen){
+	offscreen.display = NULL;
+	offscreen.context = NULL;
+	offscreen.surface = NULL;
+
+	// The client extensions : NULL when EGL has none
+	const char * clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if ( hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless") && hasExtension(clientExtensions, "EGL_EXT_platform_base") ){
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if ( getPlatformDisplay )
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if ( display == EGL_NO_DISPLAY )
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if ( display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) ){
+		fprintf(stderr, "No EGL display\n");
+		return false;
+	}
+	if ( !eglBindAPI(EGL_OPENGL_API) ){
+		fprintf(stderr, "EGL %d.%d has no desktop OpenGL\n", major, minor);
+		eglTerminate(display);
+		return false;
+	}
+
+	const char * extensions = eglQueryString(display, EGL_EXTENSIONS);
+	bool surfaceless = hasExtension(extensions, "EGL_KHR_surfaceless_context");
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = NULL;
+	EGLint configCount = 0;
+	if ( !eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0 ){
+		// The surfaceless platform may have no config at all
+		if ( !surfaceless || !hasExtension(extensions, "EGL_KHR_no_config_context") ){
+			fprintf(stderr, "No EGL config for OpenGL\n");
+			eglTerminate(display);
+			return false;
+		}
+		config = EGL_NO_CONFIG_KHR;
+	}
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if ( context == EGL_NO_CONTEXT ){
+		fprintf(stderr, "No OpenGL 3.3 core context from EGL %d.%d\n", major, minor);
+		eglTerminate(display);
+		return false;
+	}
+
+	EGLSurface surface = EGL_NO_SURFACE;
+	if ( !surfaceless ){
+		const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+	}
+	if ( (!surfaceless && surface == EGL_NO_SURFACE) || !eglMakeCurrent(display, surface, surface, context) ){
+		fprintf(stderr, "Cannot make the EGL context current\n");
+		if ( surface != EGL_NO_SURFACE )
+			eglDestroySurface(display, surface);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+
+	offscreen.display = display;
+	offscreen.context = context;
+	offscreen.surface = surface;
+	return true;
+}
+
+void deleteOffscreenContext(OffscreenContext & offscreen){
+	if ( !offscreen.display )
+		return;
+	eglMakeCurrent(offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if ( offscreen.surface != EGL_NO_SURFACE )
+		eglDestroySurface(offscreen.display, offscreen.surface);
+	eglDestroyContext(offscreen.display, offscreen.context);
+	eglTerminate(offscreen.display);
+	offscreen.display = NULL;
+}
+
+#else
+
+bool createOffscreenContext(OffscreenContext & offscreen){
+	offscreen.display = NULL;
+	fprintf(stderr, "Built without EGL : no context without a window\n");
+	return false;
+}
+
+void deleteOffscreenContext(OffscreenContext &){
+}
+
+#endif
+
+bool createOffscreenTarget(OffscreenTarget & target, int width, int height){
+	target.width = width;
+	target.height = height;
+	glGenFramebuffers(1, &target.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+	glGenRenderbuffers(1, &target.colorbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.colorbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorbuffer);
+	glGenRenderbuffers(1, &target.depthbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depthbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glViewport(0, 0, width, height);
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void deleteOffscreenTarget(OffscreenTarget & target){
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &target.depthbuffer);
+	glDeleteRenderbuffers(1, &target.colorbuffer);
+	glDeleteFramebuffers(1, &target.framebuffer);
+	target.pixels.clear();
+}
+
+void readOffscreenTarget(OffscreenTarget & target){
+	size_t rowSize = (size_t)target.width * 3;
+	std::vector<unsigned char> rows(rowSize * target.height);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target.framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, target.width, target.height, GL_RGB, GL_UNSIGNED_BYTE, &rows[0]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	// The GL's first row is the bottom one
+	target.pixels.resize(rows.size());
+	for ( int y=0; y<target.height; y++ )
+		memcpy(&target.pixels[y * rowSize], &rows[(target.height - 1 - y) * rowSize], rowSize);
+}
+
+static unsigned int crc32(unsigned int crc, const unsigned char * data, size_t size){
+	static unsigned int table[256];
+	if ( table[1] == 0 )
+		for ( unsigned int i=0; i<256; i++ ){
+			unsigned int c = i;
+			for ( int k=0; k<8; k++ )
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	crc = ~crc;
+	for ( size_t i=0; i<size; i++ )
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char> & out, unsigned int value){
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+// A chunk : its length, type and data, then the CRC of the type and data
+static void writeChunk(FILE * file, const char * type, const std::vector<unsigned char> & data){
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+	fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+static bool writePNG(const OffscreenTarget & target, FILE * file){
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, (unsigned int)target.width);
+	putBigEndian(header, (unsigned int)target.height);
+	const unsigned char format[5] = { 8, 2, 0, 0, 0 }; // 8 bits, RGB, deflate, no filter, no interlace
+	header.insert(header.end(), format, format + 5);
+	writeChunk(file, "IHDR", header);
+
+	// Each row after its filter byte (none), in stored deflate blocks of at
+	// most 65535 bytes, after the zlib header and before its Adler-32
+	size_t rowSize = (size_t)target.width * 3;
+	std::vector<unsigned char> raw;
+	raw.reserve((rowSize + 1) * target.height);
+	for ( int y=0; y<target.height; y++ ){
+		raw.push_back(0);
+		raw.insert(raw.end(), target.pixels.begin() + y * rowSize, target.pixels.begin() + (y + 1) * rowSize);
+	}
+	std::vector<unsigned char> data;
+	data.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	size_t offset = 0;
+	do {
+		size_t size = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+		data.push_back(offset + size == raw.size() ? 1 : 0);
+		data.push_back((unsigned char)size);
+		data.push_back((unsigned char)(size >> 8));
+		data.push_back((unsigned char)~size);
+		data.push_back((unsigned char)(~size >> 8));
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+		offset += size;
+	} while ( offset < raw.size() );
+	unsigned int a = 1, b = 0;
+	for ( size_t i=0; i<raw.size(); i++ ){
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(data, (b << 16) | a);
+	writeChunk(file, "IDAT", data);
+
+	writeChunk(file, "IEND", std::vector<unsigned char>());
+	return !ferror(file);
+}
+
+bool writeOffscreenImage(const OffscreenTarget & target, const char * path){
+	FILE * file = fopen(path, "wb");
+	if ( !file ){
+		fprintf(stderr, "Cannot write %s\n", path);
+		return false;
+	}
+	size_t length = strlen(path);
+	bool written;
+	if ( length >= 4 && strcmp(path + length - 4, ".png") == 0 )
+		written = writePNG(target, file);
+	else {
+		fprintf(file, "P6\n%d %d\n255\n", target.width, target.height);
+		written = fwrite(&target.pixels[0], 1, target.pixels.size(), file) == target.pixels.size();
+	}
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,40 @@
+#ifndef OFFSCREEN_HPP
+#define OFFSCREEN_HPP
+
+// A GL 3.3 core context with no window, from EGL : on Mesa's surfaceless
+// platform when it has one, so that no display is needed, and with no
+// surface when the driver allows it, a 1x1 pbuffer otherwise. llvmpipe
+// has all of it, with no GPU.
+struct OffscreenContext{
+	void * display; // EGLDisplay
+	void * context; // EGLContext
+	void * surface; // EGLSurface, EGL_NO_SURFACE when surfaceless
+};
+// Creates the context and makes it current. Returns false, after printing
+// why, when EGL has none (or the game was built without EGL).
+bool createOffscreenContext(OffscreenContext & offscreen);
+void deleteOffscreenContext(OffscreenContext & offscreen);
+
+// What the frames are drawn into in place of a window : a framebuffer
+// object with a colour and a depth renderbuffer
+struct OffscreenTarget{
+	GLuint framebuffer;
+	GLuint colorbuffer;
+	GLuint depthbuffer;
+	int width, height;
+	std::vector<unsigned char> pixels; // RGB, top row first, from readOffscreenTarget
+};
+// Creates it, binds it and sets the viewport to it. Returns false when the
+// framebuffer is not complete.
+bool createOffscreenTarget(OffscreenTarget & target, int width, int height);
+void deleteOffscreenTarget(OffscreenTarget & target);
+
+// Reads the frame back into pixels, which waits for it to be drawn
+void readOffscreenTarget(OffscreenTarget & target);
+
+// Writes pixels to path : a PNG when it ends with .png, with stored (not
+// compressed) deflate blocks, a binary PPM otherwise. Returns false when the
+// file cannot be written.
+bool writeOffscreenImage(const OffscreenTarget & target, const char * path);
+
+#endif
@@ -0,0 +1,120 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <mutex>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+#include "mesh.hpp"
+#include "texture.hpp"
+#include "resourcecache.hpp"
+
+void createResourceCache(ResourceCache & cache){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.files.clear();
+	cache.textures.clear();
+	cache.meshes.clear();
+	cache.loads = 0;
+	cache.shared = 0;
+	cache.sharedBytes = 0;
+}
+
+bool identifyResource(ResourceCache & cache, const char * path, ResourceKey & key){
+	unsigned long long size;
+	long long mtime;
+	if ( !statFile(path, size, mtime) )
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		std::map<std::string, CachedFile>::const_iterator it = cache.files.find(path);
+		if ( it != cache.files.end() && it->second.size == size && it->second.mtime == mtime ){
+			key = it->second.key;
+			return true;
+		}
+	}
+
+	// Hashed without the lock : the other threads identify their own files meanwhile
+	MappedFile file;
+	if ( !mapFile(path, file) )
+		return false;
+	key.size = file.size;
+	key.hash = hashBytes(file.data, file.size);
+	CachedFile entry = { file.size, file.mtime, key };
+	unmapFile(file);
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.files[path] = entry;
+	return true;
+}
+
+bool isTextureCached(ResourceCache & cache, const ResourceKey & key){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.textures.count(key) != 0;
+}
+
+bool isMeshCached(ResourceCache & cache, const ResourceKey & key){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.meshes.count(key) != 0;
+}
+
+bool acquireTexture(ResourceCache & cache, const ResourceKey & key, TextureLayer & layer){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.loads++;
+	std::map<ResourceKey, CachedTexture>::iterator it = cache.textures.find(key);
+	if ( it == cache.textures.end() )
+		return false;
+	it->second.references++;
+	layer = it->second.layer;
+	cache.shared++;
+	cache.sharedBytes += key.size;
+	return true;
+}
+
+bool acquireMesh(ResourceCache & cache, const ResourceKey & key, Mesh & mesh){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.loads++;
+	std::map<ResourceKey, CachedMesh>::iterator it = cache.meshes.find(key);
+	if ( it == cache.meshes.end() )
+		return false;
+	it->second.references++;
+	mesh = it->second.mesh;
+	cache.shared++;
+	cache.sharedBytes += key.size;
+	return true;
+}
+
+void addTexture(ResourceCache & cache, const ResourceKey & key, const TextureLayer & layer){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	CachedTexture & entry = cache.textures[key];
+	entry.layer = layer;
+	entry.references = 1;
+}
+
+void addMesh(ResourceCache & cache, const ResourceKey & key, const Mesh & mesh){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	CachedMesh & entry = cache.meshes[key];
+	entry.mesh = mesh;
+	entry.references = 1;
+}
+
+bool releaseTexture(ResourceCache & cache, const ResourceKey & key){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	std::map<ResourceKey, CachedTexture>::iterator it = cache.textures.find(key);
+	if ( it == cache.textures.end() || --it->second.references > 0 )
+		return false;
+	cache.textures.erase(it);
+	return true;
+}
+
+bool releaseMesh(ResourceCache & cache, const ResourceKey & key){
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	std::map<ResourceKey, CachedMesh>::iterator it = cache.meshes.find(key);
+	if ( it == cache.meshes.end() || --it->second.references > 0 )
+		return false;
+	cache.meshes.erase(it);
+	return true;
+}
@@ -0,0 +1,69 @@
+#ifndef RESOURCECACHE_HPP
+#define RESOURCECACHE_HPP
+
+// What an asset file holds : its size and a hash of its bytes. Two files
+// with the same key are loaded once, whatever their names.
+struct ResourceKey{
+	unsigned long long size;
+	unsigned long long hash; // hashBytes of the whole file
+	bool operator<(const ResourceKey & other) const {
+		return size != other.size ? size < other.size : hash < other.hash;
+	}
+};
+
+// A loaded asset and the number of handles given out for it
+struct CachedTexture{
+	TextureLayer layer;
+	unsigned int references;
+};
+struct CachedMesh{
+	Mesh mesh; // Copies of it share the GL objects
+	unsigned int references;
+};
+
+// Size, modification time and key of a file already hashed
+struct CachedFile{
+	unsigned long long size;
+	long long mtime;
+	ResourceKey key;
+};
+
+// GPU objects shared by content. Each function locks the cache, so that the
+// loading threads can identify files while the GL thread acquires and adds
+// resources; the GL calls stay with the caller.
+struct ResourceCache{
+	std::mutex mutex;
+	std::map<std::string, CachedFile> files;
+	std::map<ResourceKey, CachedTexture> textures;
+	std::map<ResourceKey, CachedMesh> meshes;
+	// Every acquire, and the file bytes of the ones served from the cache
+	unsigned int loads;
+	unsigned int shared;
+	unsigned long long sharedBytes;
+};
+void createResourceCache(ResourceCache & cache);
+
+// Computes the key of a file. The file is only read (and hashed) when this
+// path was not identified before with the same size and modification time.
+bool identifyResource(ResourceCache & cache, const char * path, ResourceKey & key);
+
+// Whether a texture or mesh with this key was added : the loading threads
+// skip reading the files the GL thread will not need.
+bool isTextureCached(ResourceCache & cache, const ResourceKey & key);
+bool isMeshCached(ResourceCache & cache, const ResourceKey & key);
+
+// Returns true and a handle to the loaded resource, one more reference,
+// or false when the caller has to load it and add it.
+bool acquireTexture(ResourceCache & cache, const ResourceKey & key, TextureLayer & layer);
+bool acquireMesh(ResourceCache & cache, const ResourceKey & key, Mesh & mesh);
+
+// Adds a resource just loaded, with one reference
+void addTexture(ResourceCache & cache, const ResourceKey & key, const TextureLayer & layer);
+void addMesh(ResourceCache & cache, const ResourceKey & key, const Mesh & mesh);
+
+// Drops a reference. Returns true when it was the last one : the caller
+// deletes the GL objects (deleteMesh; a TextureLayer goes with its TextureArray).
+bool releaseTexture(ResourceCache & cache, const ResourceKey & key);
+bool releaseMesh(ResourceCache & cache, const ResourceKey & key);
+
+#endif
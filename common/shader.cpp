@@ -1,10 +1,8 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <iostream>
-#include <fstream>
 #include <algorithm>
-#include <sstream>
+#include <chrono>
 using namespace std;
 
 #include <stdlib.h>
@@ -12,48 +10,269 @@ using namespace std;
 
 #include <GL/glew.h>
 
+#include <GLFW/glfw3.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#endif
+
+#include "mappedfile.hpp"
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// A .programcache file is a ProgramCacheHeader followed by the
+// glGetProgramBinary output. The key covers both sources and the driver's
+// vendor, renderer and version strings : a driver update rebuilds it, and
+// a driver that rejects the binary anyway is handled by compiling again.
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+#define PROGRAMCACHE_VERSION 1
+
+struct ProgramCacheHeader{
+	char magic[4]; // "GPRG"
+	unsigned int version;
+	unsigned long long key;
+	unsigned int binaryFormat;
+	unsigned int binarySize;
+};
+
+// KHR_parallel_shader_compile is newer than our GLEW
+typedef void (APIENTRY * PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// An entry point GLEW does not know, from the context that is current :
+// the EGL one of --headless, where GLFW is not initialised, or the window's
+static void * getProcAddress(const char * name){
+#ifdef HAVE_EGL
+	if ( eglGetCurrentContext() != EGL_NO_CONTEXT )
+		return (void *)eglGetProcAddress(name);
+#endif
+	return (void *)glfwGetProcAddress(name);
+}
+
+static bool hasExtension(const char * name){
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for ( GLint i=0; i<count; i++ )
+		if ( strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0 )
+			return true;
+	return false;
+}
+
+// Lets the driver compile and link on its own threads, once per context.
+// The compiles are all queued before the first status query, which is the
+// one that waits.
+static void enableParallelShaderCompile(){
+	static bool checked = false;
+	if ( checked )
+		return;
+	checked = true;
+	if ( !hasExtension("GL_KHR_parallel_shader_compile") )
+		return;
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+		(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getProcAddress("glMaxShaderCompilerThreadsKHR");
+	if ( maxShaderCompilerThreads != NULL )
+		maxShaderCompilerThreads(0xFFFFFFFF); // As many as the driver wants
+}
+
+static bool programBinariesSupported(){
+	GLint formats = 0;
+	if ( glProgramBinary == NULL || glGetProgramBinary == NULL )
+		return false;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static unsigned long long programCacheKey(const MappedFile & vertexSource, const MappedFile & fragmentSource, const char * defines){
+	unsigned long long key = hashBytes(vertexSource.data, vertexSource.size);
+	key = hashBytes(fragmentSource.data, fragmentSource.size, key);
+	if ( defines != NULL )
+		key = hashBytes(defines, strlen(defines), key);
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for ( int i=0; i<3; i++ ){
+		const char * string = (const char *)glGetString(strings[i]);
+		if ( string != NULL )
+			key = hashBytes(string, strlen(string), key);
+	}
+	unsigned int version = PROGRAMCACHE_VERSION;
+	return hashBytes(&version, sizeof(version), key);
+}
+
+// Returns the linked program, or 0 when the cache is missing, stale or
+// rejected by the driver.
+static GLuint loadProgramCache(const std::string & cachePath, unsigned long long key){
+	MappedFile file;
+	if ( !mapFile(cachePath.c_str(), file) )
+		return 0;
+
+	const ProgramCacheHeader * header = (const ProgramCacheHeader *)file.data;
+	if ( file.size < sizeof(ProgramCacheHeader)
+	  || memcmp(header->magic, "GPRG", 4) != 0
+	  || header->version != PROGRAMCACHE_VERSION
+	  || header->key     != key
+	  || file.size != sizeof(ProgramCacheHeader) + header->binarySize
+	){
+		unmapFile(file);
+		return 0;
+	}
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header->binaryFormat, file.data + sizeof(ProgramCacheHeader), header->binarySize);
+	unmapFile(file);
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if ( Result != GL_TRUE ){
+		printf("The driver rejected the program cache %s\n", cachePath.c_str());
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+// Every variant of a program has its own cache file
+static std::string programCachePath(const char * fragment_file_path, const char * defines){
+	std::string path = fragment_file_path;
+	if ( defines != NULL && defines[0] != '\0' ){
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), ".%016llx", hashBytes(defines, strlen(defines)));
+		path += suffix;
+	}
+	return path + ".programcache";
+}
+
+// Splits a source after its #version line, where the defines go : the
+// #version directive has to come first.
+static void splitVersionLine(const MappedFile & source, GLint & versionLength){
+	const char * data = (const char *)source.data;
+	versionLength = 0;
+	if ( source.size < 8 || strncmp(data, "#version", 8) != 0 )
+		return;
+	while ( (size_t)versionLength < source.size && data[versionLength] != '\n' )
+		versionLength++;
+	if ( (size_t)versionLength < source.size )
+		versionLength++;
+}
+
+static void setShaderSource(GLuint ShaderID, const MappedFile & source, const char * defines){
+	GLint versionLength;
+	splitVersionLine(source, versionLength);
+	// #line keeps the line numbers of the compile errors those of the file
+	char const * strings[4] = {
+		(char const *)source.data,
+		defines != NULL ? defines : "",
+		versionLength > 0 ? "\n#line 2\n" : "\n#line 1\n",
+		(char const *)source.data + versionLength
+	};
+	GLint lengths[4] = {
+		versionLength,
+		-1,
+		-1,
+		(GLint)(source.size - versionLength)
+	};
+	glShaderSource(ShaderID, 4, strings, lengths);
+}
+
+static bool writeProgramCache(const std::string & cachePath, unsigned long long key, GLuint ProgramID){
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if ( length <= 0 )
+		return false;
+	std::vector<unsigned char> binary(length);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(ProgramID, length, &length, &binaryFormat, &binary[0]);
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "GPRG", 4);
+	header.version      = PROGRAMCACHE_VERSION;
+	header.key          = key;
+	header.binaryFormat = binaryFormat;
+	header.binarySize   = (unsigned int)length;
+
+	// Write to a temporary file and rename it, like the mesh cache
+	std::string tempPath = cachePath + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if ( file == NULL ){
+		printf("Could not write program cache %s\n", cachePath.c_str());
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(&binary[0], 1, length, file) == (size_t)length;
+	ok = (fclose(file) == 0) && ok;
+
+	if ( ok ){
+		remove(cachePath.c_str()); // rename() does not replace existing files on Windows
+		ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+	if ( !ok ){
+		remove(tempPath.c_str());
+		printf("Could not write program cache %s\n", cachePath.c_str());
+	}
+	return ok;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
 	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}else{
+	MappedFile VertexShaderCode;
+	if ( !mapFile(vertex_file_path, VertexShaderCode) ){
 		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
 		getchar();
 		return 0;
 	}
 
 	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
+	MappedFile FragmentShaderCode;
+	if ( !mapFile(fragment_file_path, FragmentShaderCode) )
+		memset(&FragmentShaderCode, 0, sizeof(MappedFile));
+
+	// The linked program of a previous run, when nothing changed
+	bool useProgramCache = programBinariesSupported();
+	std::string cachePath = programCachePath(fragment_file_path, defines);
+	unsigned long long key = programCacheKey(VertexShaderCode, FragmentShaderCode, defines);
+	if ( useProgramCache ){
+		GLuint ProgramID = loadProgramCache(cachePath, key);
+		if ( ProgramID != 0 ){
+			unmapFile(VertexShaderCode);
+			unmapFile(FragmentShaderCode);
+			printf("Loaded program %s + %s from program cache in %.2f ms\n", vertex_file_path, fragment_file_path, elapsedMs(start));
+			return ProgramID;
+		}
 	}
+	enableParallelShaderCompile();
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
 
-	// Compile Vertex Shader
+	// Compile both shaders, then link, before checking anything : with
+	// parallel shader compile the driver works on them meanwhile
 	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
+	setShaderSource(VertexShaderID, VertexShaderCode, defines);
 	glCompileShader(VertexShaderID);
 
+	printf("Compiling shader : %s\n", fragment_file_path);
+	setShaderSource(FragmentShaderID, FragmentShaderCode, defines);
+	glCompileShader(FragmentShaderID);
+
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	if ( useProgramCache )
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glAttachShader(ProgramID, VertexShaderID);
+	glAttachShader(ProgramID, FragmentShaderID);
+	glLinkProgram(ProgramID);
+
+	unmapFile(VertexShaderCode);
+	unmapFile(FragmentShaderCode);
+
 	// Check Vertex Shader
 	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
 	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
@@ -64,13 +283,6 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	}
 
 
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
 	// Check Fragment Shader
 	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
 	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
@@ -81,14 +293,6 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	}
 
 
-
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
 	// Check the program
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
 	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
@@ -105,7 +309,33 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	if ( Result == GL_TRUE && useProgramCache )
+		writeProgramCache(cachePath, key, ProgramID);
+	printf("Compiled and linked %s + %s in %.2f ms\n", vertex_file_path, fragment_file_path, elapsedMs(start));
+
 	return ProgramID;
 }
 
+void benchmarkShaderCache(const char * vertex_file_path, const char * fragment_file_path){
+	std::string cachePath = std::string(fragment_file_path) + ".programcache";
+	if ( !programBinariesSupported() ){
+		printf("The driver has no program binary format : no program cache\n");
+		return;
+	}
+
+	remove(cachePath.c_str());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GLuint cold = LoadShaders(vertex_file_path, fragment_file_path);
+	double coldMs = elapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	GLuint warm = LoadShaders(vertex_file_path, fragment_file_path);
+	double warmMs = elapsedMs(start);
+
+	printf("%s + %s : %.2f ms with a cold program cache, %.2f ms warm, %.1fx faster\n",
+		vertex_file_path, fragment_file_path, coldMs, warmMs, coldMs / warmMs);
+	glDeleteProgram(cold);
+	glDeleteProgram(warm);
+}
+
 
@@ -1,6 +1,14 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+// Compiles and links a program, or loads the binary a previous run saved in
+// fragment_file_path + ".programcache" when the sources and driver are the same.
+// defines (e.g. "#define LIGHT_LIST\n") are inserted after the #version
+// line of both shaders; each set of defines has its own cache file.
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines = NULL);
+
+// Loads the program with no program cache, then again from the cache it
+// wrote, and prints both times.
+void benchmarkShaderCache(const char * vertex_file_path, const char * fragment_file_path);
 
 #endif
@@ -0,0 +1,625 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+#include "mesh.hpp"
+#include "texture.hpp"
+#include "shader.hpp"
+#include "glstate.hpp"
+#include "lightlist.hpp"
+#include "shading.hpp"
+
+ShadingStats shadingStats = { { 0 }, 0, 0, 0, 0.0, 0.0, 0 };
+
+static bool loadShadingProgram(ShadingProgram & variant, const char * vertex_file_path, const char * fragment_file_path,
+	const char * variantDefines){
+	// The block sizes come from here, so that the shaders match the structs
+	char defines[256];
+	snprintf(defines, sizeof(defines), "#define MAX_LIGHTS %d\n#define MAX_DRAWS %d\n#define LIGHT_TILE_SIZE %d\n#define LIGHT_OWNER_SHIFT %d\n%s",
+		SHADING_MAX_LIGHTS, SHADING_MAX_DRAWS, LIGHT_TILE_SIZE, LIGHT_OWNER_SHIFT, variantDefines);
+	variant.program = LoadShaders(vertex_file_path, fragment_file_path, defines);
+	GLint linked = GL_FALSE;
+	if ( variant.program != 0 )
+		glGetProgramiv(variant.program, GL_LINK_STATUS, &linked);
+	if ( linked != GL_TRUE ){
+		printf("Could not link the shading variant %s\n", variantDefines);
+		return false;
+	}
+
+	variant.attributes = getMeshAttributes(variant.program);
+
+	// The unlit variant has no LightData
+	const char * blocks[3] = { "FrameData", "LightData", "DrawBlock" };
+	const GLuint bindings[3] = { SHADING_FRAME_BINDING, SHADING_LIGHT_BINDING, SHADING_DRAW_BINDING };
+	for ( int i=0; i<3; i++ ){
+		GLuint index = glGetUniformBlockIndex(variant.program, blocks[i]);
+		if ( index != GL_INVALID_INDEX )
+			glUniformBlockBinding(variant.program, index, bindings[i]);
+	}
+
+	// Every variant samples texture unit 0, LIGHT_LIST the light list's units
+	useProgram(variant.program);
+	glUniform1i(glGetUniformLocation(variant.program, "myTextureSampler"), 0);
+	glUniform1i(glGetUniformLocation(variant.program, "LightBuffer"), LIGHT_BUFFER_UNIT);
+	glUniform1i(glGetUniformLocation(variant.program, "LightTileBuffer"), LIGHT_TILE_UNIT);
+	glUniform1i(glGetUniformLocation(variant.program, "LightIndexBuffer"), LIGHT_INDEX_UNIT);
+	return true;
+}
+
+bool loadShading(Shading & shading, const char * vertex_file_path, const char * fragment_file_path){
+	bool ok = loadShadingProgram(shading.lit, vertex_file_path, fragment_file_path, "");
+	ok = loadShadingProgram(shading.lightList, vertex_file_path, fragment_file_path, "#define LIGHT_LIST\n") && ok;
+	ok = loadShadingProgram(shading.unlit, vertex_file_path, fragment_file_path, "#define UNLIT\n") && ok;
+	ok = loadShadingProgram(shading.depth, vertex_file_path, fragment_file_path, "#define DEPTH_ONLY\n") && ok;
+	useProgram(0);
+
+	// FrameData and LightData share a buffer, each block at an offset the
+	// driver accepts, and stay bound
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	shading.lightOffset = ((sizeof(ShadingFrameData) + alignment - 1) / alignment) * alignment;
+	shading.frameBlock.assign(shading.lightOffset + sizeof(ShadingLightData), 0);
+
+	glGenBuffers(1, &shading.frameBuffer);
+	bindBuffer(GL_UNIFORM_BUFFER, shading.frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, shading.frameBlock.size(), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferRange(GL_UNIFORM_BUFFER, SHADING_FRAME_BINDING, shading.frameBuffer, 0, sizeof(ShadingFrameData));
+	glBindBufferRange(GL_UNIFORM_BUFFER, SHADING_LIGHT_BINDING, shading.frameBuffer, shading.lightOffset, sizeof(ShadingLightData));
+
+	glGenBuffers(1, &shading.drawBuffer);
+	bindBuffer(GL_UNIFORM_BUFFER, shading.drawBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, SHADING_MAX_DRAWS * sizeof(ShadingDrawData), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADING_DRAW_BINDING, shading.drawBuffer);
+
+	// GL 4.3, or the extensions on an older context
+	shading.multiDraw = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+	glGenBuffers(1, &shading.commandBuffer);
+	shading.sortDraws = true;
+	shading.depthPrepass = false;
+
+	glGenQueries(SHADING_TIMER_QUERIES, shading.timerQueries);
+	for ( int i=0; i<SHADING_TIMER_QUERIES; i++ )
+		shading.timerPending[i] = false;
+	shading.timerQuery = 0;
+
+	createLightList(shading.pointLights);
+	shading.lightCount = 0;
+	return ok;
+}
+
+void deleteShading(Shading & shading){
+	glDeleteProgram(shading.lit.program);
+	glDeleteProgram(shading.lightList.program);
+	glDeleteProgram(shading.unlit.program);
+	glDeleteProgram(shading.depth.program);
+	glDeleteQueries(SHADING_TIMER_QUERIES, shading.timerQueries);
+	glDeleteBuffers(1, &shading.frameBuffer);
+	glDeleteBuffers(1, &shading.drawBuffer);
+	glDeleteBuffers(1, &shading.commandBuffer);
+	deleteLightList(shading.pointLights);
+	shading.draws.clear();
+	shading.drawData.clear();
+}
+
+void beginShadingFrame(Shading & shading){
+	shading.lightCount = 0;
+	clearLights(shading.pointLights);
+	shading.draws.clear();
+	shading.drawData.clear();
+}
+
+int addShadingLight(Shading & shading, const glm::vec3 & position, const glm::vec3 & color, float power){
+	if ( shading.lightCount >= SHADING_MAX_LIGHTS )
+		return -1;
+	shading.lights.position[shading.lightCount] = glm::vec4(position, 1.0f);
+	shading.lights.color[shading.lightCount] = glm::vec4(color, power);
+	return shading.lightCount++;
+}
+
+int addShadingPointLight(Shading & shading, const glm::vec3 & position, const glm::vec3 & color, float power, float radius,
+	unsigned int owner){
+	return addLight(shading.pointLights, position, color, power, radius, owner);
+}
+
+void addShadingDraw(Shading & shading, const Mesh & mesh, unsigned int lod, const TextureLayer & texture,
+	const glm::mat4 & ModelMatrix, int light, bool unlit, unsigned int pointLightOwner){
+	ShadingDrawData data;
+	data.model          = ModelMatrix;
+	data.positionOffset = glm::vec4(mesh.positionOffset, 0.0f);
+	data.positionScale  = glm::vec4(mesh.positionScale, 0.0f);
+	data.textureRect    = glm::vec4(texture.rect[0], texture.rect[1], texture.rect[2], texture.rect[3]);
+	data.textureLayer   = glm::vec4(texture.layer, texture.maxLod, 0.0f, 0.0f);
+	data.light          = glm::ivec4(std::max(light, 0), pointLightOwner, 0, 0);
+
+	// The lit draws pick their variant once the point lights are culled
+	ShadingDraw draw;
+	draw.mesh    = &mesh;
+	draw.lod     = lod;
+	draw.texture = texture.texture;
+	draw.variant = unlit ? &shading.unlit : &shading.lit;
+	draw.firstCommand = 0;
+	draw.commandCount = 0;
+	shading.draws.push_back(draw);
+	shading.drawData.push_back(data);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The number of name among the names a frame's keys have used so far
+static unsigned long long keyIndex(std::vector<GLuint> & names, GLuint name){
+	size_t i = std::find(names.begin(), names.end(), name) - names.begin();
+	if ( i == names.size() )
+		names.push_back(name);
+	return std::min<size_t>(i, 255);
+}
+
+// Sorts the keys' indices into order, least significant byte first. A byte
+// every key shares costs no pass, and equal keys keep their order.
+static void radixSort(const std::vector<unsigned long long> & keys, std::vector<unsigned int> & order, std::vector<unsigned int> & scratch){
+	size_t count = keys.size();
+	order.resize(count);
+	scratch.resize(count);
+	unsigned long long differ = 0;
+	for ( size_t i=0; i<count; i++ ){
+		order[i] = (unsigned int)i;
+		differ |= keys[i] ^ keys[0];
+	}
+	for ( int shift=0; shift<64; shift+=8 ){
+		if ( ((differ >> shift) & 0xFF) == 0 )
+			continue;
+		unsigned int offsets[257] = { 0 };
+		for ( size_t i=0; i<count; i++ )
+			offsets[((keys[order[i]] >> shift) & 0xFF) + 1]++;
+		for ( int b=0; b<256; b++ )
+			offsets[b + 1] += offsets[b];
+		for ( size_t i=0; i<count; i++ )
+			scratch[offsets[(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+		order.swap(scratch);
+	}
+}
+
+// Puts the draws in the order of their keys. From the most significant byte :
+// the variant, the texture array, the vertex array (numbered in the order
+// the frame first uses them), then 16 bits of the distance from the eye to
+// the mesh's bounds, so that the draws sharing their state go front to back.
+static void sortShadingDraws(Shading & shading, const glm::mat4 & ViewMatrix){
+	size_t count = shading.draws.size();
+	shading.keys.resize(count);
+	shading.keyTextures.clear();
+	shading.keyVertexArrays.clear();
+	for ( size_t i=0; i<count; i++ ){
+		const ShadingDraw & draw = shading.draws[i];
+		GLuint vertexArray = shading.multiDraw && draw.mesh->arenaVertexArray != 0 ? draw.mesh->arenaVertexArray : draw.mesh->vertexArray;
+		glm::vec4 center = ViewMatrix * shading.drawData[i].model * glm::vec4(draw.mesh->boundsCenter, 1.0f);
+		// A positive float's bits sort like its value
+		float distance = glm::length(glm::vec3(center));
+		unsigned int bits;
+		memcpy(&bits, &distance, sizeof(bits));
+		unsigned long long variant = draw.variant == &shading.lit ? 0 : draw.variant == &shading.lightList ? 1 : 2;
+		shading.keys[i] = variant << 32
+			| keyIndex(shading.keyTextures, draw.texture) << 24
+			| keyIndex(shading.keyVertexArrays, vertexArray) << 16
+			| bits >> 16;
+	}
+	radixSort(shading.keys, shading.order, shading.sortScratch);
+
+	shading.sortedDraws.resize(count);
+	shading.sortedData.resize(count);
+	for ( size_t i=0; i<count; i++ ){
+		shading.sortedDraws[i] = shading.draws[shading.order[i]];
+		shading.sortedData[i] = shading.drawData[shading.order[i]];
+	}
+	shading.draws.swap(shading.sortedDraws);
+	shading.drawData.swap(shading.sortedData);
+}
+
+// Whether next can be drawn by the same glMultiDrawElementsIndirect as draw
+static bool sameMultiDraw(const ShadingDraw & draw, const ShadingDraw & next){
+	return next.commandCount > 0 && next.mesh->arenaVertexArray == draw.mesh->arenaVertexArray
+		&& next.variant == draw.variant && next.texture == draw.texture;
+}
+
+// Adds the GPU time of the frames the GL has finished to shadingStats; with
+// wait, of every frame in flight
+static void readTimerQueries(Shading & shading, bool wait){
+	for ( int i=0; i<SHADING_TIMER_QUERIES; i++ ){
+		if ( !shading.timerPending[i] )
+			continue;
+		GLint available = GL_TRUE;
+		if ( !wait )
+			glGetQueryObjectiv(shading.timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if ( !available )
+			continue;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(shading.timerQueries[i], GL_QUERY_RESULT, &elapsed);
+		shading.timerPending[i] = false;
+		shadingStats.gpuMs += elapsed / 1e6;
+		shadingStats.gpuFrames++;
+	}
+}
+
+// Draws the depth of the batch's draws with the depth program : the draws of
+// an arena together from its positions alone, whatever their texture and
+// variant. Leaves the shading pass to test GL_LEQUAL, without depth writes.
+static void drawShadingDepth(Shading & shading, size_t first, size_t count){
+	const ShadingProgram & depth = shading.depth;
+	useProgram(depth.program);
+	shadingStats.programChanges++;
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	// The shading pass counts the triangles
+	MeshDrawStats counted = meshDrawStats;
+	for ( size_t i=0; i<count; ){
+		const ShadingDraw & draw = shading.draws[first + i];
+		if ( draw.commandCount > 0 ){
+			size_t end = i + 1;
+			while ( end < count && shading.draws[first + end].commandCount > 0
+				&& shading.draws[first + end].mesh->arenaDepthVertexArray == draw.mesh->arenaDepthVertexArray )
+				end++;
+			const ShadingDraw & last = shading.draws[first + end - 1];
+			bindVertexArray(draw.mesh->arenaDepthVertexArray);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(draw.firstCommand * sizeof(MeshDrawCommand)),
+				last.firstCommand + last.commandCount - draw.firstCommand, 0);
+			shadingStats.drawCalls++;
+			i = end;
+			continue;
+		}
+		glVertexAttribI1i(depth.attributes.drawIndex, (GLint)i);
+		drawMesh(*draw.mesh, draw.lod, depth.attributes);
+		shadingStats.drawCalls += draw.mesh->chunks.empty() ? 1 : draw.mesh->chunks.size();
+		i++;
+	}
+	meshDrawStats = counted;
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_FALSE);
+	glDepthFunc(GL_LEQUAL);
+}
+
+void drawShadingFrame(Shading & shading, const glm::mat4 & ViewMatrix, const glm::mat4 & ProjectionMatrix, int width, int height){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// The query of SHADING_TIMER_QUERIES frames ago, dropped if the GL still
+	// has not answered it
+	readTimerQueries(shading, false);
+	shading.timerPending[shading.timerQuery] = false;
+	glBeginQuery(GL_TIME_ELAPSED, shading.timerQueries[shading.timerQuery]);
+
+	// A lit draw reads the tile lists only when a light it takes is in view :
+	// one with no owner, or one of its own
+	cullLights(shading.pointLights, ViewMatrix, ProjectionMatrix, width, height);
+	bool unownedLights = ownerLightsInView(shading.pointLights, 0);
+	for ( size_t i=0; i<shading.draws.size(); i++ ){
+		ShadingDraw & draw = shading.draws[i];
+		unsigned int owner = (unsigned int)shading.drawData[i].light.y;
+		if ( draw.variant == &shading.lit && (unownedLights || (owner != 0 && ownerLightsInView(shading.pointLights, owner))) )
+			draw.variant = &shading.lightList;
+	}
+	if ( shading.pointLights.tileLights > 0 )
+		bindLightList(shading.pointLights);
+
+	if ( shading.sortDraws )
+		sortShadingDraws(shading, ViewMatrix);
+
+	ShadingFrameData frame;
+	frame.view       = ViewMatrix;
+	frame.projection = ProjectionMatrix;
+	frame.lightTiles = glm::ivec4(shading.pointLights.tilesX, shading.pointLights.tilesY, 0, 0);
+	memcpy(&shading.frameBlock[0], &frame, sizeof(ShadingFrameData));
+	memcpy(&shading.frameBlock[shading.lightOffset], &shading.lights, sizeof(ShadingLightData));
+	bindBuffer(GL_UNIFORM_BUFFER, shading.frameBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, shading.frameBlock.size(), &shading.frameBlock[0]);
+	shadingStats.bufferUploads++;
+
+	bindBuffer(GL_UNIFORM_BUFFER, shading.drawBuffer);
+	const ShadingProgram * current = NULL;
+	for ( size_t first=0; first<shading.draws.size(); first+=SHADING_MAX_DRAWS ){
+		size_t count = std::min<size_t>(shading.draws.size() - first, SHADING_MAX_DRAWS);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(ShadingDrawData), &shading.drawData[first]);
+		shadingStats.bufferUploads++;
+
+		// The commands of every draw from an arena, in one upload
+		shading.commands.clear();
+		if ( shading.multiDraw ){
+			for ( size_t i=0; i<count; i++ ){
+				ShadingDraw & draw = shading.draws[first + i];
+				if ( draw.mesh->arenaVertexArray == 0 )
+					continue;
+				draw.firstCommand = (unsigned int)shading.commands.size();
+				draw.commandCount = addMeshDrawCommands(*draw.mesh, draw.lod, (unsigned int)i, shading.commands);
+			}
+			if ( !shading.commands.empty() ){
+				bindBuffer(GL_DRAW_INDIRECT_BUFFER, shading.commandBuffer);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, shading.commands.size() * sizeof(MeshDrawCommand), &shading.commands[0], GL_STREAM_DRAW);
+				shadingStats.bufferUploads++;
+			}
+		}
+
+		if ( shading.depthPrepass ){
+			drawShadingDepth(shading, first, count);
+			current = &shading.depth;
+		}
+
+		for ( size_t i=0; i<count; ){
+			const ShadingDraw & draw = shading.draws[first + i];
+			const ShadingProgram * variant = draw.variant;
+			if ( current != variant ){
+				useProgram(variant->program);
+				current = variant;
+				shadingStats.programChanges++;
+			}
+			bindTextureArray(draw.texture);
+
+			if ( draw.commandCount > 0 ){
+				size_t end = i + 1;
+				while ( end < count && sameMultiDraw(draw, shading.draws[first + end]) )
+					end++;
+				const ShadingDraw & last = shading.draws[first + end - 1];
+				bindVertexArray(draw.mesh->arenaVertexArray);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(draw.firstCommand * sizeof(MeshDrawCommand)),
+					last.firstCommand + last.commandCount - draw.firstCommand, 0);
+				shadingStats.draws[variant == &shading.lit ? 0 : variant == &shading.lightList ? 1 : 2] += end - i;
+				shadingStats.drawCalls++;
+				i = end;
+				continue;
+			}
+
+			// Read by the mesh's own vertex array, which has no vertexDrawIndex array
+			glVertexAttribI1i(variant->attributes.drawIndex, (GLint)i);
+			drawMesh(*draw.mesh, draw.lod, variant->attributes);
+			shadingStats.draws[variant == &shading.lit ? 0 : variant == &shading.lightList ? 1 : 2]++;
+			shadingStats.drawCalls += draw.mesh->chunks.empty() ? 1 : draw.mesh->chunks.size();
+			i++;
+		}
+
+		if ( shading.depthPrepass ){
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	shading.timerPending[shading.timerQuery] = true;
+	shading.timerQuery = (shading.timerQuery + 1) % SHADING_TIMER_QUERIES;
+	shadingStats.submitMs += elapsedMs(start);
+}
+
+// What the shading benchmarks draw : a full-screen quad facing +z, in clip
+// space (the matrices are identities), with a checkerboard, into a
+// framebuffer of its own
+struct ShadingBenchmark{
+	GLint viewport[4];
+	GLboolean depthTest;
+	GLboolean cullFace;
+	GLuint framebuffer;
+	GLuint colorbuffer;
+	GLuint depthbuffer; // For benchmarkDepthPrepass, the others test no depth
+	Mesh quad;
+	TextureLayer layer;
+	int size;
+};
+
+static void createShadingBenchmark(Shading & shading, int size, ShadingBenchmark & benchmark){
+	glGetIntegerv(GL_VIEWPORT, benchmark.viewport);
+	benchmark.depthTest = glIsEnabled(GL_DEPTH_TEST);
+	benchmark.cullFace = glIsEnabled(GL_CULL_FACE);
+	benchmark.size = size;
+
+	glGenFramebuffers(1, &benchmark.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, benchmark.framebuffer);
+	glGenRenderbuffers(1, &benchmark.colorbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchmark.colorbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchmark.colorbuffer);
+	glGenRenderbuffers(1, &benchmark.depthbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchmark.depthbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, benchmark.depthbuffer);
+	glViewport(0, 0, size, size);
+	// Every pass shades every pixel
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	const glm::vec3 positions[4] = { glm::vec3(-1, -1, 0), glm::vec3(1, -1, 0), glm::vec3(-1, 1, 0), glm::vec3(1, 1, 0) };
+	const glm::vec2 uvs[4] = { glm::vec2(0, 0), glm::vec2(4, 0), glm::vec2(0, 4), glm::vec2(4, 4) };
+	const glm::vec3 normals[4] = { glm::vec3(0, 0, 1), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1) };
+	const unsigned short indices[6] = { 0, 1, 2, 2, 1, 3 };
+	IndexedMesh data = IndexedMesh();
+	data.vertices    = positions;
+	data.uvs         = uvs;
+	data.normals     = normals;
+	data.indices     = indices;
+	data.vertexCount = 4;
+	data.indexCount  = 6;
+	data.indexSize   = sizeof(unsigned short);
+	createMesh(data, shading.lit.attributes, benchmark.quad);
+
+	// A one-layer checkerboard array, with its mip levels
+	const int textureSize = 256;
+	std::vector<unsigned char> checker(textureSize * textureSize * 3);
+	for ( int y=0; y<textureSize; y++ )
+		for ( int x=0; x<textureSize; x++ )
+			for ( int c=0; c<3; c++ )
+				checker[(y * textureSize + x) * 3 + c] = ((x / 16 + y / 16) & 1) ? 255 : 64;
+	TextureLayer layer = { 0, 0.0f, { 0.0f, 0.0f, 1.0f, 1.0f }, -1.0f };
+	benchmark.layer = layer;
+	glGenTextures(1, &benchmark.layer.texture);
+	bindTexture(0, GL_TEXTURE_2D_ARRAY, benchmark.layer.texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, textureSize, textureSize, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, checker.data());
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+// Draws the frame recorded passes times and returns the time of one pass
+static double timeShadingFrame(Shading & shading, const ShadingBenchmark & benchmark, int passes){
+	glm::mat4 identity(1.0f);
+	// The first draw compiles the driver's own variant of the program
+	drawShadingFrame(shading, identity, identity, benchmark.size, benchmark.size);
+	glFinish();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// One pass at a time : a renderer that bins (llvmpipe) drops the
+	// draws a later opaque draw covers
+	for ( int i=0; i<passes; i++ ){
+		drawShadingFrame(shading, identity, identity, benchmark.size, benchmark.size);
+		glFinish();
+	}
+	return elapsedMs(start) / passes;
+}
+
+static void deleteShadingBenchmark(Shading & shading, ShadingBenchmark & benchmark){
+	bindVertexArray(0);
+	deleteMesh(benchmark.quad);
+	glDeleteTextures(1, &benchmark.layer.texture);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &benchmark.colorbuffer);
+	glDeleteRenderbuffers(1, &benchmark.depthbuffer);
+	glDeleteFramebuffers(1, &benchmark.framebuffer);
+	glViewport(benchmark.viewport[0], benchmark.viewport[1], benchmark.viewport[2], benchmark.viewport[3]);
+	if ( benchmark.depthTest )
+		glEnable(GL_DEPTH_TEST);
+	if ( benchmark.cullFace )
+		glEnable(GL_CULL_FACE);
+	beginShadingFrame(shading);
+	resetGLState();
+}
+
+void benchmarkShadingVariants(Shading & shading, int size, int passes){
+	ShadingBenchmark benchmark;
+	createShadingBenchmark(shading, size, benchmark);
+	glm::mat4 identity(1.0f);
+	const glm::vec3 colors[4] = { glm::vec3(1, 1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0) };
+
+	printf("Shading variants, %d passes of %dx%d fragments :\n", passes, size, size);
+	printf("%-22s %10s %12s %10s\n", "variant", "ms/pass", "ns/fragment", "vs lit");
+	double litMs = 0.0;
+	const char * names[3] = { "lit", "LIGHT_LIST, 4 lights", "UNLIT" };
+	for ( int v=0; v<3; v++ ){
+		// The white light in front of the quad, for LIGHT_LIST a button light
+		// near each corner reaching the whole quad
+		beginShadingFrame(shading);
+		int light = addShadingLight(shading, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f), 100.0f);
+		if ( v == 1 )
+			for ( int i=0; i<4; i++ )
+				addShadingPointLight(shading, glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, 0.5f), colors[i], 2.0f, 4.0f);
+		addShadingDraw(shading, benchmark.quad, 0, benchmark.layer, identity, light, v == 2);
+
+		double passMs = timeShadingFrame(shading, benchmark, passes);
+		if ( v == 0 )
+			litMs = passMs;
+		printf("%-22s %10.3f %12.3f %9.2fx\n", names[v], passMs, passMs * 1e6 / ((double)size * size), passMs / litMs);
+	}
+
+	deleteShadingBenchmark(shading, benchmark);
+}
+
+void benchmarkLightList(Shading & shading, int size, int passes){
+	ShadingBenchmark benchmark;
+	createShadingBenchmark(shading, size, benchmark);
+	glm::mat4 identity(1.0f);
+
+	printf("Light list, %d passes of %dx%d fragments, %dx%d pixel tiles :\n", passes, size, size, LIGHT_TILE_SIZE, LIGHT_TILE_SIZE);
+	printf("%6s %-10s %12s %12s %10s %12s\n", "lights", "tiles", "lights/tile", "cull ms", "ms/pass", "ns/fragment");
+	const int counts[3] = { 4, 64, 1024 };
+	for ( int c=0; c<3; c++ ){
+		for ( int culling=0; culling<2; culling++ ){
+			// The same lights each time, scattered over the quad, each reaching
+			// a tenth of its width
+			beginShadingFrame(shading);
+			int light = addShadingLight(shading, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f), 100.0f);
+			unsigned int seed = 1;
+			for ( int i=0; i<counts[c]; i++ ){
+				float random[6];
+				for ( int r=0; r<6; r++ ){
+					seed = seed * 1664525u + 1013904223u;
+					random[r] = (seed >> 8) / 16777216.0f;
+				}
+				addShadingPointLight(shading, glm::vec3(random[0] * 2.0f - 1.0f, random[1] * 2.0f - 1.0f, 0.05f + random[2] * 0.1f),
+					glm::vec3(random[3], random[4], random[5]), 0.02f, 0.2f);
+			}
+			shading.pointLights.culling = culling != 0;
+			addShadingDraw(shading, benchmark.quad, 0, benchmark.layer, identity, light, false);
+
+			lightListStats = LightListStats();
+			double passMs = timeShadingFrame(shading, benchmark, passes);
+			printf("%6d %-10s %12.1f %12.3f %10.3f %12.3f\n", counts[c], culling ? "culled" : "all",
+				(double)lightListStats.tileLights / lightListStats.tiles, lightListStats.cullMs / (passes + 1),
+				passMs, passMs * 1e6 / ((double)size * size));
+		}
+	}
+	shading.pointLights.culling = true;
+	lightListStats = LightListStats();
+
+	deleteShadingBenchmark(shading, benchmark);
+}
+
+void benchmarkDepthPrepass(Shading & shading, int size, int layers, int passes){
+	ShadingBenchmark benchmark;
+	createShadingBenchmark(shading, size, benchmark);
+	// The quads hide each other, and stay in the order they are added
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	bool sortDraws = shading.sortDraws;
+	bool depthPrepass = shading.depthPrepass;
+	shading.sortDraws = false;
+	const glm::vec3 colors[4] = { glm::vec3(1, 1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0) };
+
+	printf("Depth pre-pass, %d quads of %dx%d fragments drawn back to front, LIGHT_LIST with 4 lights, %d passes :\n", layers, size, size, passes);
+	printf("%-16s %12s %12s %10s\n", "", "GPU ms/pass", "CPU ms/pass", "draw calls");
+	double shadingOnlyMs = 0.0;
+	for ( int prepass=0; prepass<2; prepass++ ){
+		beginShadingFrame(shading);
+		int light = addShadingLight(shading, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f), 100.0f);
+		for ( int i=0; i<4; i++ )
+			addShadingPointLight(shading, glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, 0.5f), colors[i], 2.0f, 4.0f);
+		for ( int l=0; l<layers; l++ ){
+			// From the far plane towards the eye
+			glm::mat4 model(1.0f);
+			model[3].z = 0.9f - 1.8f * l / std::max(layers - 1, 1);
+			addShadingDraw(shading, benchmark.quad, 0, benchmark.layer, model, light, false);
+		}
+		shading.depthPrepass = prepass != 0;
+		glm::mat4 identity(1.0f);
+
+		// The first frame compiles the driver's variants
+		glClear(GL_DEPTH_BUFFER_BIT);
+		drawShadingFrame(shading, identity, identity, size, size);
+		glFinish();
+		readTimerQueries(shading, true);
+		shadingStats = ShadingStats();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for ( int i=0; i<passes; i++ ){
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawShadingFrame(shading, identity, identity, size, size);
+			glFinish();
+		}
+		double cpuMs = elapsedMs(start) / passes;
+		readTimerQueries(shading, true);
+		double gpuMs = shadingStats.gpuFrames > 0 ? shadingStats.gpuMs / shadingStats.gpuFrames : 0.0;
+		if ( prepass == 0 )
+			shadingOnlyMs = gpuMs;
+		printf("%-16s %12.3f %12.3f %10llu", prepass ? "depth pre-pass" : "shading only", gpuMs, cpuMs, shadingStats.drawCalls / passes);
+		if ( prepass && gpuMs > 0.0 )
+			printf("  %.2fx faster", shadingOnlyMs / gpuMs);
+		printf("\n");
+	}
+	shading.sortDraws = sortDraws;
+	shading.depthPrepass = depthPrepass;
+	shadingStats = ShadingStats();
+
+	glDisable(GL_DEPTH_TEST);
+	deleteShadingBenchmark(shading, benchmark);
+}
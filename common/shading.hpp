@@ -0,0 +1,163 @@
+#ifndef SHADING_HPP
+#define SHADING_HPP
+
+// The most main lights of one frame; the light list has the others
+#define SHADING_MAX_LIGHTS 16
+// The draws one upload of the draw buffer holds; a frame with more is drawn
+// in several batches
+#define SHADING_MAX_DRAWS 64
+// The frames whose GPU time can be in flight at once
+#define SHADING_TIMER_QUERIES 4
+
+// Uniform buffer binding points of the blocks
+#define SHADING_FRAME_BINDING 0
+#define SHADING_LIGHT_BINDING 1
+#define SHADING_DRAW_BINDING  2
+
+// The std140 uniform blocks of StandardShading, member for member.
+// FrameData : the camera, for every draw of the frame.
+struct ShadingFrameData{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::ivec4 lightTiles; // x LightList::tilesX
+};
+// LightData : the main lights of the frame. The draws refer to them by index.
+struct ShadingLightData{
+	glm::vec4 position[SHADING_MAX_LIGHTS]; // xyz, world space
+	glm::vec4 color[SHADING_MAX_LIGHTS];    // rgb colour, a power
+};
+// DrawBlock : one element of its array per draw, picked by the vertexDrawIndex attribute.
+struct ShadingDrawData{
+	glm::mat4 model;
+	glm::vec4 positionOffset; // Mesh::positionOffset
+	glm::vec4 positionScale;  // Mesh::positionScale
+	glm::vec4 textureRect;    // TextureLayer::rect
+	glm::vec4 textureLayer;   // x TextureLayer::layer, y TextureLayer::maxLod
+	glm::ivec4 light;         // x the white light, y the owner of the point lights it takes
+};
+
+// One variant of StandardShading, compiled with its own #defines
+struct ShadingProgram{
+	GLuint program;
+	MeshAttributes attributes; // drawIndex included
+};
+
+// A draw recorded for drawShadingFrame
+struct ShadingDraw{
+	const Mesh * mesh;
+	unsigned int lod;
+	GLuint texture; // TextureLayer::texture
+	const ShadingProgram * variant;
+	unsigned int firstCommand; // Its commands in Shading::commands, for a mesh of an arena
+	unsigned int commandCount;
+};
+
+// The variants of the program :
+// lit has the white light only,
+// lightList adds the lights of the light list that reach each tile (LIGHT_LIST),
+// for the lit draws that take a light in view,
+// unlit only samples the texture (UNLIT),
+// depth only writes the depth, for the depth pre-pass (DEPTH_ONLY).
+// The draws of a frame are recorded, sorted by the state they need and then
+// front to back, and their data goes to the GPU in one upload per uniform
+// buffer; each draw only sets its index. The draws of meshes in a MeshArena
+// that follow each other with the same program and texture array are one
+// glMultiDrawElementsIndirect, their index being their base instance.
+struct Shading{
+	ShadingProgram lit;
+	ShadingProgram lightList;
+	ShadingProgram unlit;
+	ShadingProgram depth;
+	GLuint frameBuffer; // FrameData, then LightData at lightOffset
+	GLuint drawBuffer;  // DrawBlock
+	GLintptr lightOffset;
+	std::vector<unsigned char> frameBlock; // What frameBuffer receives
+	// Whether the GL has glMultiDrawElementsIndirect and base instances;
+	// false draws every mesh on its own
+	bool multiDraw;
+	GLuint commandBuffer; // GL_DRAW_INDIRECT_BUFFER
+	std::vector<MeshDrawCommand> commands;
+	// false draws in the order of addShadingDraw
+	bool sortDraws;
+	// The sort, kept from frame to frame for their memory
+	std::vector<unsigned long long> keys;
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> sortScratch;
+	std::vector<GLuint> keyTextures;
+	std::vector<GLuint> keyVertexArrays;
+	std::vector<ShadingDraw> sortedDraws;
+	std::vector<ShadingDrawData> sortedData;
+	// Draws the depth of every draw first, from the arena's positions alone,
+	// then shades with GL_LEQUAL and no depth writes : a pixel the draws
+	// overlap is shaded once
+	bool depthPrepass;
+	// GL_TIME_ELAPSED of the last frames, read once the GL has them
+	GLuint timerQueries[SHADING_TIMER_QUERIES];
+	bool timerPending[SHADING_TIMER_QUERIES];
+	unsigned int timerQuery; // The next one
+	// The frame being recorded
+	ShadingLightData lights;
+	unsigned int lightCount;
+	LightList pointLights; // The button lights, and any other
+	std::vector<ShadingDraw> draws;
+	std::vector<ShadingDrawData> drawData;
+};
+
+// Compiles (or loads from the program cache) every variant and creates the
+// uniform buffers. Returns false when one of the variants does not link.
+bool loadShading(Shading & shading, const char * vertex_file_path, const char * fragment_file_path);
+void deleteShading(Shading & shading);
+
+// Starts recording a frame : no lights and no draws
+void beginShadingFrame(Shading & shading);
+
+// Adds a main light to the frame and returns its index, or -1 when the frame
+// has SHADING_MAX_LIGHTS already. The white light has power 100.
+int addShadingLight(Shading & shading, const glm::vec3 & position, const glm::vec3 & color, float power);
+
+// Adds a light to the light list : it lights every lit draw within radius,
+// or with an owner (1 to 255), only the draws of that owner
+int addShadingPointLight(Shading & shading, const glm::vec3 & position, const glm::vec3 & color, float power, float radius,
+	unsigned int owner = 0);
+
+// Records a draw lit by the main light of index light and the point lights
+// around it that have no owner or pointLightOwner. unlit draws with the
+// texture only.
+void addShadingDraw(Shading & shading, const Mesh & mesh, unsigned int lod, const TextureLayer & texture,
+	const glm::mat4 & ModelMatrix, int light, bool unlit, unsigned int pointLightOwner = 0);
+
+// Culls the point lights for a viewport width x height pixels, sorts the
+// draws, uploads the frame's buffers and draws what was recorded, seen
+// through these matrices. The binds go through the GL state cache
+// (glstate.hpp), which resetGLState must forget after TwDraw.
+// The depth test must be on, with GL_LESS; the depth pre-pass changes the
+// depth function and mask and puts them back.
+// With multiDraw, the meshes of a MeshArena created with SHADING_MAX_DRAWS
+// draw indices are drawn together.
+void drawShadingFrame(Shading & shading, const glm::mat4 & ViewMatrix, const glm::mat4 & ProjectionMatrix, int width, int height);
+
+// What drawShadingFrame did since the last reset
+struct ShadingStats{
+	unsigned long long draws[3]; // lit, lightList, unlit
+	unsigned long long programChanges;
+	unsigned long long bufferUploads;
+	unsigned long long drawCalls; // A glMultiDrawElementsIndirect is one
+	double submitMs;              // CPU time in drawShadingFrame
+	double gpuMs;                 // GPU time of the frames in gpuFrames
+	unsigned long long gpuFrames; // The frames whose GPU time came back
+};
+extern ShadingStats shadingStats;
+
+// Shades a full-screen quad size x size pixels passes times with each
+// variant and prints the time per pass and per fragment.
+void benchmarkShadingVariants(Shading & shading, int size = 1024, int passes = 20);
+
+// Shades the same quad with 4, 64 and 1024 point lights, each listed in every
+// tile and then culled per tile, and prints the culling and shading times.
+void benchmarkLightList(Shading & shading, int size = 1024, int passes = 5);
+
+// Shades layers full-screen quads drawn back to front, the worst order, with
+// and without the depth pre-pass, and prints the GPU time per pass of both.
+void benchmarkDepthPrepass(Shading & shading, int size = 1024, int layers = 8, int passes = 20);
+
+#endif
@@ -8,6 +8,7 @@
 using namespace glm;
 
 #include "shader.hpp"
+#include "mappedfile.hpp"
 #include "texture.hpp"
 
 #include "text2D.hpp"
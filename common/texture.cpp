@@ -1,11 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 
 #include <GL/glew.h>
 
 #include <GLFW/glfw3.h>
 
+#include "mappedfile.hpp"
+#include "glstate.hpp"
+#include "texture.hpp"
+
 
 GLuint loadBMP_custom(const char * imagepath){
 
@@ -124,7 +131,7 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
 
-GLuint loadDDS(const char * imagepath){
+GLuint loadDDS_slow(const char * imagepath){
 
 	unsigned char header[124];
 
@@ -164,7 +171,6 @@ GLuint loadDDS(const char * imagepath){
 	/* close the file pointer */ 
 	fclose(fp);
 
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
 	unsigned int format;
 	switch(fourCC) 
 	{ 
@@ -213,6 +219,392 @@ GLuint loadDDS(const char * imagepath){
 	free(buffer); 
 
 	return textureID;
+}
+
+#define DDS_HEADER_SIZE 124
+#define DDSD_MIPMAPCOUNT 0x20000
+
+bool readDDS(const char * imagepath, DDSImage & image){
+	image.mipMapCount = 0;
+	image.levels.clear();
+	if ( !mapFile(imagepath, image.file) ){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+
+	/* verify the type of file and the size of the surface desc */
+	const unsigned char * data = image.file.data;
+	if ( image.file.size < 4 + DDS_HEADER_SIZE || strncmp((const char *)data, "DDS ", 4) != 0
+	  || *(const unsigned int*)&(data[4]) != DDS_HEADER_SIZE ){
+		printf("%s is not a DDS file\n", imagepath);
+		releaseDDS(image);
+		return false;
+	}
+	const unsigned char * header = data + 4;
+	unsigned int flags       = *(const unsigned int*)&(header[4 ]);
+	image.height             = *(const unsigned int*)&(header[8 ]);
+	image.width              = *(const unsigned int*)&(header[12]);
+	unsigned int mipMapCount = *(const unsigned int*)&(header[24]);
+	unsigned int fourCC      = *(const unsigned int*)&(header[80]);
+
+	switch(fourCC) 
+	{ 
+	case FOURCC_DXT1: 
+		image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
+		break; 
+	case FOURCC_DXT3: 
+		image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
+		break; 
+	case FOURCC_DXT5: 
+		image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
+		break; 
+	default: 
+		printf("%s : only DXT1, DXT3 and DXT5 DDS files are supported\n", imagepath);
+		releaseDDS(image);
+		return false; 
+	}
+	if ( image.width == 0 || image.height == 0 ){
+		printf("%s : empty DDS image\n", imagepath);
+		releaseDDS(image);
+		return false;
+	}
+
+	// Without DDSD_MIPMAPCOUNT there is only the base level, and no chain is
+	// longer than the one down to 1x1
+	if ( !(flags & DDSD_MIPMAPCOUNT) || mipMapCount == 0 )
+		mipMapCount = 1;
+	unsigned int fullChain = 1;
+	for ( unsigned int size = std::max(image.width, image.height); size > 1; size /= 2 )
+		fullChain++;
+	mipMapCount = std::min(mipMapCount, fullChain);
+
+	/* the exact size of every level, checked against the file */
+	unsigned int blockSize = (image.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+	unsigned long long offset = 4 + DDS_HEADER_SIZE;
+	unsigned int width = image.width;
+	unsigned int height = image.height;
+	for ( unsigned int level = 0; level < mipMapCount; ++level ){
+		unsigned long long size = (unsigned long long)((width+3)/4) * ((height+3)/4) * blockSize;
+		if ( offset + size > image.file.size ){
+			printf("%s is truncated : %u of %u mip levels present\n", imagepath, level, mipMapCount);
+			break;
+		}
+		DDSLevel entry = { width, height, (unsigned int)offset, (unsigned int)size };
+		image.levels.push_back(entry);
+		offset += size;
+		width  = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	if ( image.levels.empty() ){
+		releaseDDS(image);
+		return false;
+	}
+	image.mipMapCount = (unsigned int)image.levels.size();
+
+	// Fault the pages in here, on the reading thread
+	volatile unsigned char sum = 0;
+	for ( unsigned long long i = 0; i < offset; i += 4096 )
+		sum += data[i];
+	return true;
+}
+
+void releaseDDS(DDSImage & image){
+	unmapFile(image.file);
+}
+
+void createPixelUnpackRing(PixelUnpackRing & ring){
+	glGenBuffers(PIXEL_UNPACK_RING_SIZE, ring.buffers);
+	for ( int i = 0; i < PIXEL_UNPACK_RING_SIZE; i++ ){
+		ring.fences[i] = 0;
+		ring.capacities[i] = 0;
+	}
+	ring.next = 0;
+	ring.stalls = 0;
+}
+
+void deletePixelUnpackRing(PixelUnpackRing & ring){
+	for ( int i = 0; i < PIXEL_UNPACK_RING_SIZE; i++ ){
+		if ( ring.fences[i] )
+			glDeleteSync(ring.fences[i]);
+		ring.fences[i] = 0;
+	}
+	glDeleteBuffers(PIXEL_UNPACK_RING_SIZE, ring.buffers);
+}
+
+// Binds the next buffer of the ring to GL_PIXEL_UNPACK_BUFFER and copies
+// size bytes into it, once the GL is done reading its previous contents.
+static void fillPixelUnpackBuffer(PixelUnpackRing & ring, const unsigned char * data, GLsizeiptr size){
+	unsigned int slot = ring.next;
+	ring.next = (ring.next + 1) % PIXEL_UNPACK_RING_SIZE;
+
+	if ( ring.fences[slot] ){
+		if ( glClientWaitSync(ring.fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED ){
+			ring.stalls++;
+			glClientWaitSync(ring.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+		}
+		glDeleteSync(ring.fences[slot]);
+		ring.fences[slot] = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffers[slot]);
+	if ( ring.capacities[slot] < size ){
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		ring.capacities[slot] = size;
+	}
+	// The fence above guarantees the GL is not reading this buffer any more
+	void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if ( mapped != NULL ){
+		memcpy(mapped, data, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}else{
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, data);
+	}
+}
+
+// Fences the buffer fillPixelUnpackBuffer returned last, once the GL call
+// reading it is queued.
+static void fencePixelUnpackBuffer(PixelUnpackRing & ring){
+	unsigned int slot = (ring.next + PIXEL_UNPACK_RING_SIZE - 1) % PIXEL_UNPACK_RING_SIZE;
+	ring.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint uploadDDS(const DDSImage & image, PixelUnpackRing * ring){
+
+	// Create one OpenGL texture
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+
+	// "Bind" the newly created texture : all future texture functions will modify this texture
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
+
+	/* load the mipmaps */ 
+	for ( unsigned int level = 0; level < image.mipMapCount; ++level ){
+		const DDSLevel & l = image.levels[level];
+		if ( ring != NULL ){
+			fillPixelUnpackBuffer(*ring, image.file.data + l.offset, l.size);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height, 0, l.size, (void*)0);
+			fencePixelUnpackBuffer(*ring);
+		}else{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height, 0, l.size, image.file.data + l.offset);
+		}
+	}
+	if ( ring != NULL )
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// A truncated chain is still complete for the mipmap filters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.mipMapCount - 1);
+
+	return textureID;
+}
+
+GLuint loadDDS(const char * imagepath){
+	DDSImage image;
+	if (!readDDS(imagepath, image))
+		return 0;
+	GLuint textureID = uploadDDS(image);
+	releaseDDS(image);
+	return textureID;
+}
+
+// Allocates every level of a GL_TEXTURE_2D_ARRAY and leaves it bound
+static GLuint allocateTextureArray(unsigned int width, unsigned int height, unsigned int levels, unsigned int layers, unsigned int format){
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+
+	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+	for ( unsigned int level = 0; level < levels; ++level ){
+		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize;
+		glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, width, height, layers, 0, size * layers, NULL);
+		width  = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	return textureID;
+}
+
+// Uploads the first levels of image into a layer of the bound texture array,
+// at (x, y) of level 0. x and y must be multiples of 4 << (levels - 1).
+static void uploadDDSLayer(const DDSImage & image, unsigned int levels, unsigned int layer,
+	unsigned int x, unsigned int y, unsigned int arrayWidth, unsigned int arrayHeight, PixelUnpackRing * ring){
+	for ( unsigned int level = 0; level < levels; ++level ){
+		const DDSLevel & l = image.levels[level];
+		// Whole blocks, unless the rectangle ends on the edge of the level
+		unsigned int levelX = x >> level;
+		unsigned int levelY = y >> level;
+		unsigned int width  = std::min((l.width + 3) & ~3u, std::max(arrayWidth >> level, 1u) - levelX);
+		unsigned int height = std::min((l.height + 3) & ~3u, std::max(arrayHeight >> level, 1u) - levelY);
+		if ( ring != NULL ){
+			fillPixelUnpackBuffer(*ring, image.file.data + l.offset, l.size);
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, levelX, levelY, layer, width, height, 1, image.format, l.size, (void*)0);
+			fencePixelUnpackBuffer(*ring);
+		}else{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, levelX, levelY, layer, width, height, 1, image.format, l.size, image.file.data + l.offset);
+		}
+	}
+	if ( ring != NULL )
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void createTextureArray(TextureArray & array, unsigned int capacity){
+	array.texture = 0;
+	array.width = 0;
+	array.height = 0;
+	array.levels = 0;
+	array.format = 0;
+	array.layers = 0;
+	array.capacity = capacity;
+	array.atlasLayer = -1;
+	array.shelfX = 0;
+	array.shelfY = 0;
+	array.shelfHeight = 0;
+	array.fallbacks.clear();
+}
+
+TextureLayer addTextureToArray(TextureArray & array, const DDSImage & image, PixelUnpackRing * ring){
+	TextureLayer result = { 0, 0.0f, { 0.0f, 0.0f, 1.0f, 1.0f }, -1.0f };
+	if ( image.mipMapCount == 0 )
+		return result;
+
+	if ( array.texture == 0 && array.capacity > 0 ){
+		array.width = image.width;
+		array.height = image.height;
+		array.levels = image.mipMapCount;
+		array.format = image.format;
+		array.texture = allocateTextureArray(array.width, array.height, array.levels, array.capacity, array.format);
+	}
+	bool sameFormat = array.texture != 0 && image.format == array.format;
+
+	// A layer of its own
+	if ( sameFormat && image.width == array.width && image.height == array.height && array.layers < array.capacity ){
+		unsigned int levels = std::min(image.mipMapCount, array.levels);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+		uploadDDSLayer(image, levels, array.layers, 0, 0, array.width, array.height, ring);
+		result.texture = array.texture;
+		result.layer = (float)array.layers++;
+		if ( levels < array.levels )
+			result.maxLod = (float)(levels - 1);
+		return result;
+	}
 
+	// A rectangle of an atlas layer : on the current shelf, on a new shelf
+	// above it, or on a new atlas layer
+	if ( sameFormat && image.width <= array.width && image.height <= array.height ){
+		unsigned int width = (image.width + 3) & ~3u;
+		unsigned int height = (image.height + 3) & ~3u;
+		if ( array.atlasLayer >= 0 && array.shelfX + width > array.width ){
+			array.shelfX = 0;
+			array.shelfY += array.shelfHeight;
+			array.shelfHeight = 0;
+		}
+		if ( array.atlasLayer < 0 || array.shelfY + height > array.height ){
+			if ( array.layers < array.capacity ){
+				array.atlasLayer = array.layers++;
+				array.shelfX = 0;
+				array.shelfY = 0;
+				array.shelfHeight = 0;
+			}else{
+				array.atlasLayer = -1;
+			}
+		}
+		if ( array.atlasLayer >= 0 ){
+			unsigned int x = array.shelfX;
+			unsigned int y = array.shelfY;
+			// The levels whose rectangle still starts on a block; the
+			// smaller ones would mix with the neighbours
+			unsigned int levels = 1;
+			while ( levels < std::min(image.mipMapCount, array.levels)
+			     && ((x >> levels) << levels) == x && (x >> levels) % 4 == 0
+			     && ((y >> levels) << levels) == y && (y >> levels) % 4 == 0 )
+				levels++;
+
+			glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+			uploadDDSLayer(image, levels, array.atlasLayer, x, y, array.width, array.height, ring);
+			result.texture = array.texture;
+			result.layer = (float)array.atlasLayer;
+			result.rect[0] = (float)x / array.width;
+			result.rect[1] = (float)y / array.height;
+			result.rect[2] = (float)image.width / array.width;
+			result.rect[3] = (float)image.height / array.height;
+			result.maxLod = (float)(levels - 1);
+			array.shelfX += width;
+			array.shelfHeight = std::max(array.shelfHeight, height);
+			return result;
+		}
+	}
+
+	// Another format, bigger than the layers, or no layer left
+	GLuint textureID = allocateTextureArray(image.width, image.height, image.mipMapCount, 1, image.format);
+	uploadDDSLayer(image, image.mipMapCount, 0, 0, 0, image.width, image.height, ring);
+	array.fallbacks.push_back(textureID);
+	result.texture = textureID;
+	return result;
+}
+
+void deleteTextureArray(TextureArray & array){
+	if ( array.texture )
+		glDeleteTextures(1, &array.texture);
+	if ( !array.fallbacks.empty() )
+		glDeleteTextures((GLsizei)array.fallbacks.size(), array.fallbacks.data());
+	createTextureArray(array, 0);
+}
+
+TextureBindStats textureBindStats = { 0, 0 };
 
+void bindTextureArray(GLuint texture){
+	if ( bindTexture(0, GL_TEXTURE_2D_ARRAY, texture) )
+		textureBindStats.binds++;
+	textureBindStats.layers++;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkDDSLoader(const char * const * paths, int count){
+	PixelUnpackRing ring;
+	createPixelUnpackRing(ring);
+
+	double totalSlow = 0.0, totalMapped = 0.0, totalRing = 0.0;
+	printf("%-28s %10s %12s %12s %12s\n", "texture", "KB", "fread (ms)", "mmap (ms)", "PBO ring (ms)");
+	for ( int i = 0; i < count; i++ ){
+		// Warm the file cache, so that every path reads from memory
+		DDSImage image;
+		if ( !readDDS(paths[i], image) )
+			continue;
+		unsigned long long fileSize = image.file.size;
+		releaseDDS(image);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GLuint slow = loadDDS_slow(paths[i]);
+		glFinish();
+		double slowMs = elapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		readDDS(paths[i], image);
+		GLuint mapped = uploadDDS(image);
+		releaseDDS(image);
+		glFinish();
+		double mappedMs = elapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		readDDS(paths[i], image);
+		GLuint ringed = uploadDDS(image, &ring);
+		releaseDDS(image);
+		glFinish();
+		double ringMs = elapsedMs(start);
+
+		printf("%-28s %10.1f %12.3f %12.3f %12.3f\n", paths[i], fileSize / 1024.0, slowMs, mappedMs, ringMs);
+		totalSlow += slowMs;
+		totalMapped += mappedMs;
+		totalRing += ringMs;
+		glDeleteTextures(1, &slow);
+		glDeleteTextures(1, &mapped);
+		glDeleteTextures(1, &ringed);
+	}
+	printf("%-28s %10s %12.3f %12.3f %12.3f (%u ring stalls)\n", "total", "", totalSlow, totalMapped, totalRing, ring.stalls);
+	deletePixelUnpackRing(ring);
 }
\ No newline at end of file
@@ -12,5 +12,102 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// The original loadDDS : fread into a buffer sized linearSize * 2, which is
+// too small for some mip chains, and upload from client memory. Kept as the
+// reference for benchmarkDDSLoader.
+GLuint loadDDS_slow(const char * imagepath);
+
+// One mip level of a DDS file, offset from the start of the file
+struct DDSLevel{
+	unsigned int width;
+	unsigned int height;
+	unsigned int offset;
+	unsigned int size;
+};
+
+// The two halves of loadDDS : readDDS does no GL call and can run on any
+// thread, uploadDDS must run on the thread that owns the GL context.
+struct DDSImage{
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipMapCount; // Levels present in the file, 0 when readDDS failed
+	unsigned int format; // GL_COMPRESSED_RGBA_S3TC_DXT*_EXT
+	std::vector<DDSLevel> levels;
+	MappedFile file; // The levels are read straight from the mapping
+};
+
+// Maps the file, checks the header and computes the exact size of every
+// level; levels cut off by the end of the file are dropped. The pages are
+// touched so that the upload does not wait for the disk.
+bool readDDS(const char * imagepath, DDSImage & image);
+void releaseDDS(DDSImage & image);
+
+// A ring of pixel unpack buffers for texture uploads. A level is copied into
+// the next buffer and glCompressedTexImage2D reads it from there, so the
+// driver can copy it to the texture later; a fence tells when the buffer
+// may be written again.
+#define PIXEL_UNPACK_RING_SIZE 4
+struct PixelUnpackRing{
+	GLuint buffers[PIXEL_UNPACK_RING_SIZE];
+	GLsync fences[PIXEL_UNPACK_RING_SIZE];
+	GLsizeiptr capacities[PIXEL_UNPACK_RING_SIZE];
+	unsigned int next;
+	unsigned int stalls; // Uploads that had to wait for their buffer
+};
+void createPixelUnpackRing(PixelUnpackRing & ring);
+void deletePixelUnpackRing(PixelUnpackRing & ring);
+
+// Uploads through ring, or from the mapped file when ring is NULL.
+GLuint uploadDDS(const DDSImage & image, PixelUnpackRing * ring = NULL);
+
+// Where a texture was put in a TextureArray : a layer of its own, or a
+// rectangle of an atlas layer shared with other textures of the same format.
+struct TextureLayer{
+	GLuint texture; // GL_TEXTURE_2D_ARRAY
+	float layer;
+	float rect[4]; // UV offset (x, y) and scale (z, w) of the rectangle
+	float maxLod; // Last mip level that is the texture's own, -1 for all of them
+};
+
+// Packs DDS textures into the layers of one GL_TEXTURE_2D_ARRAY, so that a
+// frame can draw all of them with one bind. The first texture added sets the
+// size, format and mip levels of the array. Smaller textures of the same
+// format are packed into atlas layers, and the others (or all of them, with
+// a capacity of 0) get a one-layer array of their own.
+struct TextureArray{
+	GLuint texture;
+	unsigned int width;
+	unsigned int height;
+	unsigned int levels;
+	unsigned int format;
+	unsigned int layers; // Used so far
+	unsigned int capacity;
+	// Shelf of the atlas layer being filled, -1 when there is none
+	int atlasLayer;
+	unsigned int shelfX;
+	unsigned int shelfY;
+	unsigned int shelfHeight;
+	std::vector<GLuint> fallbacks; // The one-layer arrays
+};
+void createTextureArray(TextureArray & array, unsigned int capacity);
+TextureLayer addTextureToArray(TextureArray & array, const DDSImage & image, PixelUnpackRing * ring = NULL);
+void deleteTextureArray(TextureArray & array);
+
+// Binds a texture array on texture unit 0, unless it is already bound there
+// (see glstate.hpp). The programs read the layer from a uniform buffer (see
+// shading.hpp).
+void bindTextureArray(GLuint texture);
+
+// What bindTextureArray did since the last reset
+struct TextureBindStats{
+	unsigned long long binds;
+	unsigned long long layers; // Calls
+};
+extern TextureBindStats textureBindStats;
+
+// Loads every DDS with loadDDS_slow, with readDDS + uploadDDS from the
+// mapping, and with readDDS + uploadDDS through a PixelUnpackRing, and prints
+// the time per texture of each path, up to glFinish.
+void benchmarkDDSLoader(const char * const * paths, int count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false){
+	if ( threadCount == 0 )
+		threadCount = std::thread::hardware_concurrency();
+	if ( threadCount == 0 ) // hardware_concurrency() may not know
+		threadCount = 1;
+
+	workers.reserve(threadCount);
+	for ( unsigned int i = 0; i < threadCount; i++ )
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for ( unsigned int i = 0; i < workers.size(); i++ )
+		workers[i].join();
+}
+
+void ThreadPool::enqueue(std::function<void()> job){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop(){
+	for ( ;; ){
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while ( !stopping && jobs.empty() )
+				jobAvailable.wait(lock);
+			if ( jobs.empty() )
+				return; // stopping, and nothing left to do
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void CompletionQueue::push(std::function<void()> job){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	jobAvailable.notify_one();
+}
+
+std::function<void()> CompletionQueue::pop(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while ( jobs.empty() )
+		jobAvailable.wait(lock);
+	std::function<void()> job = jobs.front();
+	jobs.pop_front();
+	return job;
+}
@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+// A fixed set of worker threads running jobs in FIFO order.
+// Jobs must not touch GL : only the thread that created the context may.
+class ThreadPool{
+public:
+	// threadCount == 0 : one worker per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool(); // Finishes the queued jobs, then joins the workers
+
+	void enqueue(std::function<void()> job);
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+private:
+	ThreadPool(const ThreadPool &);
+	ThreadPool & operator=(const ThreadPool &);
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque< std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping;
+};
+
+// Work handed back from the workers to the GL thread.
+// Workers push, the GL thread pops and runs each job itself.
+class CompletionQueue{
+public:
+	void push(std::function<void()> job);
+	std::function<void()> pop(); // Blocks until a job is available
+
+private:
+	std::deque< std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+};
+
+#endif
@@ -1,8 +1,13 @@
 #include <vector>
 #include <map>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
 
 #include <glm/glm.hpp>
 
+#include "objloader.hpp"
 #include "vboindexer.hpp"
 
 #include <string.h> // for memcmp
@@ -85,10 +90,10 @@ struct PackedVertex{
 
 bool getSimilarVertexIndex_fast( 
 	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
+	std::map<PackedVertex,unsigned int> & VertexToOutIndex,
+	unsigned int & result
 ){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
+	std::map<PackedVertex,unsigned int>::iterator it = VertexToOutIndex.find(packed);
 	if ( it == VertexToOutIndex.end() ){
 		return false;
 	}else{
@@ -97,17 +102,17 @@ bool getSimilarVertexIndex_fast(
 	}
 }
 
-void indexVBO(
+void indexVBO_map(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	std::map<PackedVertex,unsigned int> VertexToOutIndex;
 
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
@@ -116,7 +121,7 @@ void indexVBO(
 		
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
+		unsigned int index;
 		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
@@ -125,18 +130,359 @@ void indexVBO(
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
+			unsigned int newindex = (unsigned int)out_vertices.size() - 1;
 			out_indices .push_back( newindex );
 			VertexToOutIndex[ packed ] = newindex;
 		}
 	}
 }
 
+// Both faster versions below compare vertices bit for bit, like the memcmp in
+// PackedVertex::operator<, and number the unique vertices in order of first
+// appearance, so they produce exactly the same buffers as indexVBO_map.
 
+static_assert(sizeof(PackedVertex) == 32, "PackedVertex is hashed as four 64-bit words");
 
+static inline unsigned long long mix64(unsigned long long h){
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
 
+static inline unsigned long long hashVertex(const glm::vec3 & position, const glm::vec2 & uv, const glm::vec3 & normal){
+	PackedVertex packed = {position, uv, normal};
+	unsigned long long words[4];
+	memcpy(words, &packed, sizeof(PackedVertex));
+	// Independent multiplies, then one full avalanche
+	return mix64( words[0] * 0x9e3779b97f4a7c15ULL
+	            ^ words[1] * 0xc2b2ae3d27d4eb4fULL
+	            ^ words[2] * 0x165667b19e3779f9ULL
+	            ^ words[3] * 0xd6e8feb86659fd93ULL );
+}
+
+static inline bool sameVertex(
+	const glm::vec3 & position1, const glm::vec2 & uv1, const glm::vec3 & normal1,
+	const glm::vec3 & position2, const glm::vec2 & uv2, const glm::vec3 & normal2
+){
+	return memcmp(&position1, &position2, sizeof(glm::vec3)) == 0
+	    && memcmp(&uv1,       &uv2,       sizeof(glm::vec2)) == 0
+	    && memcmp(&normal1,   &normal2,   sizeof(glm::vec3)) == 0;
+}
+
+// One slot of the open addressing table. index is the output index + 1, 0 marks an empty slot.
+struct VertexSlot{
+	unsigned int hash; // High bits of the hash, checked before the full compare
+	unsigned int index;
+};
 
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	size_t count = in_vertices.size();
+	if ( count >= INDEXVBO_PARALLEL_THRESHOLD && std::thread::hardware_concurrency() > 1 ){
+		indexVBO_sort(in_vertices, in_uvs, in_normals, out_indices, out_vertices, out_uvs, out_normals);
+		return;
+	}
 
+	// Power of two, at most half full : probe sequences stay short
+	size_t capacity = 16;
+	while ( capacity < count * 2 )
+		capacity *= 2;
+	size_t mask = capacity - 1;
+	std::vector<VertexSlot> slots(capacity);
+
+	out_indices.reserve(out_indices.size() + count);
+
+	for ( size_t i=0; i<count; i++ ){
+		unsigned long long hash = hashVertex(in_vertices[i], in_uvs[i], in_normals[i]);
+		unsigned int tag = (unsigned int)(hash >> 32);
+
+		size_t slot = (size_t)hash & mask;
+		for ( ;; ){
+			VertexSlot & current = slots[slot];
+			if ( current.index == 0 ){ // Not seen yet : add it to the output data
+				out_vertices.push_back( in_vertices[i]);
+				out_uvs     .push_back( in_uvs[i]);
+				out_normals .push_back( in_normals[i]);
+				current.hash  = tag;
+				current.index = (unsigned int)out_vertices.size();
+				out_indices.push_back( current.index - 1 );
+				break;
+			}
+			unsigned int index = current.index - 1;
+			if ( current.hash == tag && sameVertex(in_vertices[i], in_uvs[i], in_normals[i], out_vertices[index], out_uvs[index], out_normals[index]) ){
+				out_indices.push_back( index );
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+}
+
+// Runs work(thread) on threadCount threads, the calling thread being thread 0.
+template <typename Work>
+static void runOnThreads(unsigned int threadCount, Work work){
+	std::vector<std::thread> threads;
+	for ( unsigned int t=1; t<threadCount; t++ )
+		threads.push_back(std::thread(work, t));
+	work(0);
+	for ( unsigned int t=0; t<threads.size(); t++ )
+		threads[t].join();
+}
+
+static inline size_t chunkStart(size_t count, unsigned int chunk, unsigned int chunkCount){
+	return (size_t)((unsigned long long)count * chunk / chunkCount);
+}
+
+struct SortedVertex{
+	unsigned int key; // High bits of the vertex hash
+	unsigned int index; // Position in the input arrays
+};
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+void indexVBO_sort(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	unsigned int threadCount
+){
+	size_t count = in_vertices.size();
+	if ( threadCount == 0 )
+		threadCount = std::thread::hardware_concurrency();
+	if ( threadCount == 0 )
+		threadCount = 1;
+	if ( threadCount > count / 1024 + 1 ) // Not worth a thread
+		threadCount = (unsigned int)(count / 1024 + 1);
+
+	// 1. Hash every vertex
+	std::vector<SortedVertex> sorted(count);
+	std::vector<SortedVertex> scratch(count);
+	runOnThreads(threadCount, [&](unsigned int t){
+		size_t end = chunkStart(count, t + 1, threadCount);
+		for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ ){
+			sorted[i].key   = (unsigned int)(hashVertex(in_vertices[i], in_uvs[i], in_normals[i]) >> 32);
+			sorted[i].index = (unsigned int)i;
+		}
+	});
+
+	// 2. Stable LSD radix sort on the 32-bit keys, 3 passes of 11 bits.
+	// Each thread counts its own chunk, then scatters it behind the
+	// chunks of the threads before it, so equal keys keep increasing indices.
+	std::vector<size_t> offsets(threadCount * RADIX_BUCKETS);
+	for ( unsigned int shift=0; shift<32; shift+=RADIX_BITS ){
+		std::fill(offsets.begin(), offsets.end(), 0);
+		runOnThreads(threadCount, [&](unsigned int t){
+			size_t * histogram = &offsets[t * RADIX_BUCKETS];
+			size_t end = chunkStart(count, t + 1, threadCount);
+			for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ )
+				histogram[(sorted[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+		});
+		size_t position = 0;
+		for ( unsigned int bucket=0; bucket<RADIX_BUCKETS; bucket++ ){
+			for ( unsigned int t=0; t<threadCount; t++ ){
+				size_t bucketSize = offsets[t * RADIX_BUCKETS + bucket];
+				offsets[t * RADIX_BUCKETS + bucket] = position;
+				position += bucketSize;
+			}
+		}
+		runOnThreads(threadCount, [&](unsigned int t){
+			size_t * offset = &offsets[t * RADIX_BUCKETS];
+			size_t end = chunkStart(count, t + 1, threadCount);
+			for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ )
+				scratch[offset[(sorted[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = sorted[i];
+		});
+		sorted.swap(scratch);
+	}
+	std::vector<SortedVertex>().swap(scratch);
+
+	// 3. Unique : within a run of equal keys, every vertex points to the first
+	// vertex of the run that is bitwise equal to it. Runs are never split between threads.
+	std::vector<unsigned int> first(count);
+	runOnThreads(threadCount, [&](unsigned int t){
+		size_t begin = chunkStart(count, t, threadCount);
+		size_t end = chunkStart(count, t + 1, threadCount);
+		while ( begin > 0 && begin < count && sorted[begin].key == sorted[begin - 1].key )
+			begin++;
+		while ( end > 0 && end < count && sorted[end].key == sorted[end - 1].key )
+			end++;
+
+		std::vector<unsigned int> candidates; // Distinct vertices of the current run
+		for ( size_t i=begin; i<end; i++ ){
+			if ( i == begin || sorted[i].key != sorted[i - 1].key )
+				candidates.clear();
+			unsigned int index = sorted[i].index;
+			unsigned int match = index;
+			for ( size_t c=0; c<candidates.size(); c++ ){
+				unsigned int other = candidates[c];
+				if ( sameVertex(in_vertices[index], in_uvs[index], in_normals[index], in_vertices[other], in_uvs[other], in_normals[other]) ){
+					match = other;
+					break;
+				}
+			}
+			if ( match == index )
+				candidates.push_back(index);
+			first[index] = match;
+		}
+	});
+	std::vector<SortedVertex>().swap(sorted);
+
+	// 4. Number the unique vertices in order of first appearance : count them
+	// per chunk, then each chunk numbers and copies its own.
+	std::vector<size_t> chunkBase(threadCount + 1);
+	runOnThreads(threadCount, [&](unsigned int t){
+		size_t unique = 0;
+		size_t end = chunkStart(count, t + 1, threadCount);
+		for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ )
+			unique += first[i] == i;
+		chunkBase[t + 1] = unique;
+	});
+	chunkBase[0] = out_vertices.size();
+	for ( unsigned int t=0; t<threadCount; t++ )
+		chunkBase[t + 1] += chunkBase[t];
+
+	out_vertices.resize(chunkBase[threadCount]);
+	out_uvs     .resize(chunkBase[threadCount]);
+	out_normals .resize(chunkBase[threadCount]);
+	std::vector<unsigned int> outIndex(count);
+	runOnThreads(threadCount, [&](unsigned int t){
+		size_t next = chunkBase[t];
+		size_t end = chunkStart(count, t + 1, threadCount);
+		for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ ){
+			if ( first[i] != i )
+				continue;
+			out_vertices[next] = in_vertices[i];
+			out_uvs     [next] = in_uvs[i];
+			out_normals [next] = in_normals[i];
+			outIndex[i] = (unsigned int)next++;
+		}
+	});
+
+	// 5. Every vertex takes the index of its first appearance
+	size_t indexBase = out_indices.size();
+	out_indices.resize(indexBase + count);
+	runOnThreads(threadCount, [&](unsigned int t){
+		size_t end = chunkStart(count, t + 1, threadCount);
+		for ( size_t i=chunkStart(count, t, threadCount); i<end; i++ )
+			out_indices[indexBase + i] = outIndex[first[i]];
+	});
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+typedef void (*IndexVBOFunction)(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &
+);
+
+static void indexVBO_sortAllThreads(
+	std::vector<glm::vec3> & in_vertices, std::vector<glm::vec2> & in_uvs, std::vector<glm::vec3> & in_normals,
+	std::vector<unsigned int> & out_indices, std::vector<glm::vec3> & out_vertices, std::vector<glm::vec2> & out_uvs, std::vector<glm::vec3> & out_normals
+){
+	indexVBO_sort(in_vertices, in_uvs, in_normals, out_indices, out_vertices, out_uvs, out_normals);
+}
+
+struct IndexedBuffers{
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+};
+
+// Best of 5 runs
+static double timeIndexVBO(
+	IndexVBOFunction function,
+	std::vector<glm::vec3> & vertices, std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals,
+	IndexedBuffers & result
+){
+	double best = 0.0;
+	for ( int run=0; run<5; run++ ){
+		result = IndexedBuffers();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		function(vertices, uvs, normals, result.indices, result.vertices, result.uvs, result.normals);
+		double ms = elapsedMs(start);
+		if ( run == 0 || ms < best )
+			best = ms;
+	}
+	return best;
+}
+
+static bool sameBuffers(const IndexedBuffers & a, const IndexedBuffers & b){
+	return a.indices.size() == b.indices.size()
+	    && a.vertices.size() == b.vertices.size()
+	    && memcmp(a.indices.data(),  b.indices.data(),  a.indices.size()  * sizeof(unsigned int)) == 0
+	    && memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(glm::vec3)) == 0
+	    && memcmp(a.uvs.data(),      b.uvs.data(),      a.uvs.size()      * sizeof(glm::vec2)) == 0
+	    && memcmp(a.normals.data(),  b.normals.data(),  a.normals.size()  * sizeof(glm::vec3)) == 0;
+}
+
+static void benchmarkIndexVBORow(
+	const char * name,
+	std::vector<glm::vec3> & vertices, std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals
+){
+	IndexedBuffers mapResult, hashResult, sortResult;
+	double mapMs  = timeIndexVBO(indexVBO_map, vertices, uvs, normals, mapResult);
+	double hashMs = timeIndexVBO(indexVBO, vertices, uvs, normals, hashResult);
+	double sortMs = timeIndexVBO(indexVBO_sortAllThreads, vertices, uvs, normals, sortResult);
+	bool same = sameBuffers(mapResult, hashResult) && sameBuffers(mapResult, sortResult);
+	printf("%-28s %9u %8u %10.2f %10.2f %10.2f %8.1fx %s\n", name,
+		(unsigned int)vertices.size(), (unsigned int)mapResult.vertices.size(),
+		mapMs, hashMs, sortMs, mapMs / hashMs, same ? "identical" : "DIFFERENT");
+}
+
+void benchmarkIndexVBO(const char * const * paths, int count){
+	printf("%u threads, indexVBO switches to indexVBO_sort from %u vertices\n",
+		std::thread::hardware_concurrency(), (unsigned int)INDEXVBO_PARALLEL_THRESHOLD);
+	printf("%-28s %9s %8s %10s %10s %10s %9s\n", "mesh", "vertices", "unique", "map (ms)", "hash (ms)", "sort (ms)", "map/hash");
+
+	std::vector<glm::vec3> allVertices;
+	std::vector<glm::vec2> allUvs;
+	std::vector<glm::vec3> allNormals;
+	for ( int i=0; i<count; i++ ){
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		if ( !loadOBJ(paths[i], vertices, uvs, normals) )
+			continue;
+		benchmarkIndexVBORow(paths[i], vertices, uvs, normals);
+		allVertices.insert(allVertices.end(), vertices.begin(), vertices.end());
+		allUvs     .insert(allUvs.end(),      uvs.begin(),      uvs.end());
+		allNormals .insert(allNormals.end(),  normals.begin(),  normals.end());
+	}
+	if ( allVertices.empty() )
+		return;
+
+	// The assets are small : repeat all of them, shifted a little on each
+	// copy, to get an input where the parallel path matters.
+	size_t assetVertices = allVertices.size();
+	for ( int copy=1; allVertices.size() < 4 * INDEXVBO_PARALLEL_THRESHOLD; copy++ ){
+		for ( size_t i=0; i<assetVertices; i++ ){
+			allVertices.push_back( allVertices[i] + glm::vec3((float)(copy % 4), 0.0f, 0.0f) );
+			allUvs     .push_back( allUvs[i] );
+			allNormals .push_back( allNormals[i] );
+		}
+	}
+	benchmarkIndexVBORow("all assets, repeated", allVertices, allUvs, allNormals);
+}
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -1,17 +1,52 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+// Inputs from this size up are indexed with indexVBO_sort when there is more than one core
+#define INDEXVBO_PARALLEL_THRESHOLD (1 << 20)
+
+// Deduplicates bitwise-equal vertices with an open addressing hash table.
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// The previous std::map version, kept as the reference for indexVBO.
+void indexVBO_map(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same result as indexVBO, by a multithreaded radix sort of the vertex
+// hashes followed by a unique pass. threadCount == 0 : one per core.
+void indexVBO_sort(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	unsigned int threadCount = 0
+);
+
+// Indexes every OBJ with the three versions, prints the timings and checks
+// that the buffers are identical.
+void benchmarkIndexVBO(const char * const * paths, int count);
+
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -1834,6 +1834,27 @@ void _glfwPlatformWaitEvents(void)
     _glfwPlatformPollEvents();
 }
 
+void _glfwPlatformWaitEventsTimeout(double timeout)
+{
+    // NOTE: The time left is computed again after every wakeup, as select is
+    //       not required to update its timeout value
+    const double deadline = _glfwPlatformGetTime() + timeout;
+
+    while (!XPending(_glfw.x11.display))
+    {
+        struct timeval tv;
+        const double remaining = deadline - _glfwPlatformGetTime();
+        if (remaining <= 0.0)
+            return;
+
+        tv.tv_sec = (long) remaining;
+        tv.tv_usec = (long) ((remaining - tv.tv_sec) * 1e6);
+        selectDisplayConnection(&tv);
+    }
+
+    _glfwPlatformPollEvents();
+}
+
 void _glfwPlatformPostEmptyEvent(void)
 {
     XEvent event;
@@ -5,7 +5,18 @@
 #include <queue>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <ctime>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <string>
 // Include GLEW
 #include <GL/glew.h>
 // Include GLFW
@@ -22,10 +33,23 @@ using namespace glm;
 // Include AntTweakBar
 #include <AntTweakBar.h>
 #include <common/shader.hpp>
+#include <common/mappedfile.hpp>
 #include <common/texture.hpp>
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+#include <common/meshcache.hpp>
+#include <common/meshoptimizer.hpp>
+#include <common/threadpool.hpp>
+#include <common/glcalls.hpp>
+#include <common/glstate.hpp>
+#include <common/mesh.hpp>
+#include <common/lightlist.hpp>
+#include <common/shading.hpp>
+#include <common/culling.hpp>
+#include <common/inputqueue.hpp>
+#include <common/offscreen.hpp>
+#include <common/resourcecache.hpp>
 #include <common/quaternion_utils.hpp> // See quaternion_utils.cpp for RotationBetweenVectors, LookAt and RotateTowards
 
 // ----------------------------------------------------------------  FIM INCLUDES ----------------------------------------------------------------
@@ -33,96 +57,17 @@ using namespace glm;
 vec3 gPosition1(-0.5f, -1.0f, 0.5f);
 vec3 gOrientation1;
 
-// -------------------------------------------------------  INICIO LOAD BUFFERS -----------------------------------------------------------------
-void loadBuffers(
-	std::vector<unsigned short> indices,
-	std::vector<glm::vec3> indexed_vertices,
-	std::vector<glm::vec2> indexed_uvs,
-	std::vector<glm::vec3> indexed_normals,
-	GLuint *vertexbuffer,
-	GLuint *uvbuffer,
-	GLuint *normalbuffer,
-	GLuint *elementbuffer
-){
-	glGenBuffers(1, vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, *vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-	glGenBuffers(1, uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, *uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-	glGenBuffers(1, normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, *normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-	glGenBuffers(1, elementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
-}
+const char * objFiles[] = {
+	"telaInicial.obj", "botaoAmarelo.obj", "botaoAzul.obj", "botaoVerde.obj", "botaoVermelho.obj",
+	"botaoAmareloEsquerdo.obj", "botaoAmareloDireito.obj", "botaoVermelhoMeio.obj",
+	"mesa.obj", "restoJogo.obj", "meioRestoJogo.obj"
+};
 
-// -------------------------------------------------------  INICIO BIND BUFFER  -----------------------------------------------------------------
-void bindBuffer(GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint elementbuffer, GLuint programID)
-{
-	GLuint vertexPosition_modelspaceID = glGetAttribLocation(programID, "vertexPosition_modelspace");
-	GLuint vertexUVID = glGetAttribLocation(programID, "vertexUV");
-	GLuint vertexNormal_modelspaceID = glGetAttribLocation(programID, "vertexNormal_modelspace");
-	// 1rst attribute buffer: vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glVertexAttribPointer(
-		vertexPosition_modelspaceID,  // The attribute we want to configure
-		3,                            // size
-		GL_FLOAT,                     // type
-		GL_FALSE,                     // normalized?
-		0,                            // stride
-		(void*)0                      // array buffer offset
-	);
-	// 2nd attribute buffer: UVs
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glVertexAttribPointer(
-		vertexUVID,                   // The attribute we want to configure
-		2,                            // size : U+V => 2
-		GL_FLOAT,                     // type
-		GL_FALSE,                     // normalized?
-		0,                            // stride
-		(void*)0                      // array buffer offset
-	);
-	// 3rd attribute buffer: normals
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glVertexAttribPointer(
-		vertexNormal_modelspaceID,    // The attribute we want to configure
-		3,                            // size
-		GL_FLOAT,                     // type
-		GL_FALSE,                     // normalized?
-		0,                            // stride
-		(void*)0                      // array buffer offset
-	);
-	// Index buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-}
-
-// ------------------------------------------------------  INICIO DELETE BUFFERS ---------------------------------------------------------------
-void deleteBuffers(GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint elementbuffer)
-{
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &normalbuffer);
-	glDeleteBuffers(1, &elementbuffer);
-}
-
-// ------------------------------------------------------  INICIO RENDER DOS OBJ ---------------------------------------------------------------
-void Render(GLuint MatrixID, GLuint Texture, GLuint TextureID, int indiceFinal, glm::mat4 ModelMatrix){
-	// Draw the triangles !
-	glDrawElements(
-		GL_TRIANGLES,        // mode
-		indiceFinal,         // count
-		GL_UNSIGNED_SHORT,   // type
-		(void*)0        // elemenft array buffer offset
-	);
-}
+const char * ddsFiles[] = {
+	"telaInicial.dds", "botaoAmarelo.dds", "botaoAzul.dds", "botaoVerde.dds", "botaoVermelho.dds",
+	"botaoAmareloEsquerdo.dds", "botaoAmareloDireito.dds", "botaoVermelhoMeio.dds",
+	"mesa.dds", "restoJogo.dds", "meioRestoJogo.dds"
+};
 
 /*
  * Sortea o código da cor (entre 1 e 4)
@@ -165,37 +110,596 @@ bool acertouOrdem(std::queue<int> corSelecionadaJogo, std::queue<int> corSelecio
 	return acertouOrdem(corSelecionadaJogo, corSelecionadaJogador);
 }
 
+/*
+ * O código da cor que um evento aperta, 0 para nenhuma :
+ * as setas, ou os quatro primeiros botões do joystick
+*/
+int corDoEvento(const InputEvent & event)
+{
+	if (event.action != GLFW_PRESS) {
+		return 0;
+	}
+	if (event.type == INPUT_KEY) {
+		switch (event.code) {
+		case GLFW_KEY_UP:    return 1;
+		case GLFW_KEY_RIGHT: return 2;
+		case GLFW_KEY_LEFT:  return 3;
+		case GLFW_KEY_DOWN:  return 4;
+		}
+	}
+	if (event.type == INPUT_JOYSTICK_BUTTON && event.code < 4) {
+		return event.code + 1;
+	}
+	return 0;
+}
+
+// -------------------------------------------------------  INICIO LOAD ASSETS -----------------------------------------------------------------
+struct MeshLoad {
+	const char * path;
+	Mesh * mesh;
+	bool merge; // Part of the static batch : read, but uploaded with the others by createStaticBatch
+	vec3 batchOffset; // Where the batch puts it, in board space
+	double readMs;
+	double uploadMs;
+	IndexedMesh data;
+	ResourceKey key;
+	bool identified; // false when the file could not be read
+};
+
+struct TextureLoad {
+	const char * path;
+	TextureLayer * texture;
+	double readMs;
+	double uploadMs;
+	DDSImage image;
+	ResourceKey key;
+	bool identified;
+};
+
+// The loads start with every field empty but these
+MeshLoad meshLoad(const char * path, Mesh * mesh, bool merge = false, vec3 batchOffset = vec3(0.0f))
+{
+	MeshLoad load = MeshLoad();
+	load.path = path;
+	load.mesh = mesh;
+	load.merge = merge;
+	load.batchOffset = batchOffset;
+	return load;
+}
+
+TextureLoad textureLoad(const char * path, TextureLayer * texture)
+{
+	TextureLoad load = TextureLoad();
+	load.path = path;
+	load.texture = texture;
+	return load;
+}
+
+// glfwGetTime is not safe to call from the worker threads
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// loadIndexedOBJ flags, see meshcache.hpp
+unsigned int meshLoadFlags = MESH_GENERATE_LODS;
+
+// Largest simplification error allowed on screen, in pixels. 0 always draws the full meshes.
+float lodPixelError = 1.0f;
+
+// Attribute locations of the shader program, the vertex arrays are built with them
+MeshAttributes meshAttributes;
+// Draw with the texture only, no lights (UNLIT variant)
+bool unlitShading = false;
+
+// Upload the vertices as PackedMeshVertex, see mesh.hpp
+bool quantizeVertices = false;
+// The texture uploads go through it, so that the copies overlap with the GL
+PixelUnpackRing textureUploadRing;
+// The board textures, packed into the layers of one texture array
+TextureArray textureArray;
+bool separateTextures = false;
+// Files with the same bytes share their GPU objects
+ResourceCache resourceCache;
+
+// No GL call : runs on any thread
+void readMesh(MeshLoad * load)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// A part of the batch needs its vertices, even when an identical file is on the GPU
+	load->identified = !load->merge && identifyResource(resourceCache, load->path, load->key);
+	// The key's hash is the OBJ's : loadIndexedOBJ does not hash it again
+	if (!load->identified || !isMeshCached(resourceCache, load->key))
+		loadIndexedOBJ(load->path, load->data, meshLoadFlags, load->identified ? &load->key.hash : NULL);
+	load->readMs = elapsedMs(start);
+}
+
+void readTexture(TextureLoad * load)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	load->identified = identifyResource(resourceCache, load->path, load->key);
+	load->image.mipMapCount = 0;
+	if (!load->identified || !isTextureCached(resourceCache, load->key))
+		if (!readDDS(load->path, load->image))
+			load->image.mipMapCount = 0;
+	load->readMs = elapsedMs(start);
+}
+
+// GL thread only
+void uploadMesh(MeshLoad * load)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (load->merge) {
+		load->uploadMs = 0.0;
+		return;
+	}
+	if (load->identified && acquireMesh(resourceCache, load->key, *load->mesh)) {
+		releaseMeshData(load->data);
+		load->uploadMs = elapsedMs(start);
+		return;
+	}
+	MeshQuantizationError error;
+	createMesh(load->data, meshAttributes, *load->mesh, quantizeVertices, &error);
+	if (load->identified)
+		addMesh(resourceCache, load->key, *load->mesh);
+	load->uploadMs = elapsedMs(start);
+	if (quantizeVertices && load->data.vertexCount > 0)
+		printf("Quantized %s : %.1f KB saved, max error position %f, normal %.3f deg, UV %f\n",
+			load->path, load->data.vertexCount * (sizeof(MeshVertex) - sizeof(PackedMeshVertex)) / 1024.0,
+			error.position, error.normal, error.uv);
+	releaseMeshData(load->data);
+}
+
+void uploadTexture(TextureLoad * load)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!load->identified || !acquireTexture(resourceCache, load->key, *load->texture)) {
+		*load->texture = load->image.mipMapCount > 0 ? addTextureToArray(textureArray, load->image, &textureUploadRing) : TextureLayer();
+		if (load->identified && load->image.mipMapCount > 0)
+			addTexture(resourceCache, load->key, *load->texture);
+	}
+	releaseDDS(load->image);
+	load->uploadMs = elapsedMs(start);
+}
+
+// Identifies the texture files up front (their keys are remembered, the
+// loading threads do not hash them again) and counts the different ones :
+// the texture array gets no layer for a duplicate.
+unsigned int countDistinctTextures(TextureLoad * textures, int textureCount)
+{
+	std::map<ResourceKey, bool> distinct;
+	unsigned int count = 0;
+	for (int i = 0; i < textureCount; i++) {
+		ResourceKey key;
+		if (!identifyResource(resourceCache, textures[i].path, key))
+			count++;
+		else
+			distinct[key] = true;
+	}
+	return count + (unsigned int)distinct.size();
+}
+
+void loadAssetsSerial(MeshLoad * meshes, int meshCount, TextureLoad * textures, int textureCount)
+{
+	for (int i = 0; i < textureCount; i++) {
+		readTexture(&textures[i]);
+		uploadTexture(&textures[i]);
+	}
+	for (int i = 0; i < meshCount; i++) {
+		readMesh(&meshes[i]);
+		uploadMesh(&meshes[i]);
+	}
+}
+
+// Reads every asset on a pool with one thread per core. Each finished read
+// queues its upload, and the GL thread runs the uploads as they arrive.
+// Returns the number of worker threads.
+unsigned int loadAssetsParallel(MeshLoad * meshes, int meshCount, TextureLoad * textures, int textureCount)
+{
+	ThreadPool pool;
+	CompletionQueue uploads;
+
+	// Biggest files first : the meshes cost more than the textures when there is no mesh cache
+	for (int i = 0; i < meshCount; i++) {
+		MeshLoad * load = &meshes[i];
+		pool.enqueue([load, &uploads] {
+			readMesh(load);
+			uploads.push([load] { uploadMesh(load); });
+		});
+	}
+	for (int i = 0; i < textureCount; i++) {
+		TextureLoad * load = &textures[i];
+		pool.enqueue([load, &uploads] {
+			readTexture(load);
+			uploads.push([load] { uploadTexture(load); });
+		});
+	}
+
+	// Every job pushes exactly one upload, even when its read failed
+	for (int done = 0; done < meshCount + textureCount; done++)
+		uploads.pop()();
+
+	return pool.size();
+}
+
 std::queue<int> clear()
 {
    return std::queue<int>();
 }
 
+// ------------------------------------------------------  REDESENHO SOB DEMANDA ---------------------------------------------------------------
+// What a frame shows. The loop only draws when it differs from the last frame
+// drawn, or when redrawRequested; otherwise it waits for an event or for the
+// next timer of the game.
+struct FrameState {
+	glm::vec3 cameraPosition;
+	glm::vec3 cameraLookTo;
+	glm::vec3 cameraHead;
+	glm::vec3 boardPosition;    // The GUI's settings
+	glm::vec3 boardOrientation;
+	float lightPowers[4];
+	bool ortho;
+	bool renderTelaInicial;
+	bool todosBotoesExibidos;
+	bool gameOver;
+	int pontuacao;
+	int sequence; // Colours of the game's sequence, then of the player's
+	int played;
+	bool depthPrepass;
+	int width, height;
+};
+
+bool sameFrameState(const FrameState & a, const FrameState & b)
+{
+	for (int i = 0; i < 4; i++)
+		if (a.lightPowers[i] != b.lightPowers[i])
+			return false;
+	return a.cameraPosition == b.cameraPosition && a.cameraLookTo == b.cameraLookTo && a.cameraHead == b.cameraHead
+		&& a.boardPosition == b.boardPosition && a.boardOrientation == b.boardOrientation
+		&& a.ortho == b.ortho && a.renderTelaInicial == b.renderTelaInicial && a.todosBotoesExibidos == b.todosBotoesExibidos
+		&& a.gameOver == b.gameOver && a.pontuacao == b.pontuacao && a.sequence == b.sequence && a.played == b.played
+		&& a.depthPrepass == b.depthPrepass && a.width == b.width && a.height == b.height;
+}
+
+// Set by the GUI when it handles the mouse, and when the window must be redrawn
+bool redrawRequested = true;
+// Whether the last mouse event was the GUI's : leaving the bar redraws it once more
+bool mouseOverGui = false;
+
+// ------------------------------------------------------  SEM JANELA ---------------------------------------------------------------
+// --headless : no window and no GLFW. The frames are drawn into a framebuffer
+// object of an EGL context, the clock is the frames' (headlessFrameTime each)
+// and the keys are the scenario's.
+bool headless = false;
+const double headlessFrameTime = 1.0 / 60.0;
+double headlessTime = 0.0;
+bool headlessKeys[GLFW_KEY_LAST + 1];
+
+double getTime()
+{
+	return headless ? headlessTime : glfwGetTime();
+}
+
+int getKey(GLFWwindow * window, int key)
+{
+	if (headless)
+		return headlessKeys[key] ? GLFW_PRESS : GLFW_RELEASE;
+	return glfwGetKey(window, key);
+}
+
+// Whether a --dump-frames pattern is safe to give snprintf with the frame's
+// number : one %d, with flags and a width at most, and otherwise only %%
+bool isDumpPattern(const char * pattern)
+{
+	int numbers = 0;
+	for (const char * c = pattern; *c; c++) {
+		if (*c != '%')
+			continue;
+		if (c[1] == '%') {
+			c++;
+			continue;
+		}
+		c++;
+		while (*c && strchr("-+ #0", *c))
+			c++;
+		while (isdigit((unsigned char)*c))
+			c++;
+		if (*c != 'd')
+			return false;
+		numbers++;
+	}
+	return numbers == 1;
+}
+
+// One line of a scenario : at time (seconds of the game's clock) a key is
+// pressed or released, or the frame is written out
+struct ScenarioStep {
+	double time;
+	int key;    // -1 : write the frame
+	int action; // GLFW_PRESS or GLFW_RELEASE
+};
+
+// Reads a scenario, one step a line, in the order of their times :
+//   <seconds> press <key>
+//   <seconds> release <key>
+//   <seconds> dump
+// The keys are the game's : ENTER, UP, DOWN, LEFT, RIGHT, P, F1, F2, F3 and
+// ESCAPE, which ends the run. # starts a comment.
+bool loadScenario(const char * path, std::vector<ScenarioStep> & steps)
+{
+	static const struct { const char * name; int key; } keys[] = {
+		{ "ENTER", GLFW_KEY_ENTER }, { "UP", GLFW_KEY_UP }, { "DOWN", GLFW_KEY_DOWN },
+		{ "LEFT", GLFW_KEY_LEFT }, { "RIGHT", GLFW_KEY_RIGHT }, { "P", GLFW_KEY_P },
+		{ "F1", GLFW_KEY_F1 }, { "F2", GLFW_KEY_F2 }, { "F3", GLFW_KEY_F3 }, { "ESCAPE", GLFW_KEY_ESCAPE }
+	};
+	FILE * file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Cannot open the scenario %s\n", path);
+		return false;
+	}
+	char line[256];
+	int lineNumber = 0;
+	bool valid = true;
+	while (valid && fgets(line, sizeof(line), file)) {
+		lineNumber++;
+		char * comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		double time;
+		char command[32], name[32];
+		int fields = sscanf(line, "%lf %31s %31s", &time, command, name);
+		if (fields <= 0)
+			continue;
+		ScenarioStep step = { time, -1, GLFW_PRESS };
+		if (fields == 2 && strcmp(command, "dump") == 0) {
+			steps.push_back(step);
+			continue;
+		}
+		valid = fields == 3 && (strcmp(command, "press") == 0 || strcmp(command, "release") == 0);
+		step.action = strcmp(command, "press") == 0 ? GLFW_PRESS : GLFW_RELEASE;
+		for (size_t i = 0; valid && i < sizeof(keys) / sizeof(keys[0]); i++)
+			if (strcmp(name, keys[i].name) == 0)
+				step.key = keys[i].key;
+		valid = valid && step.key >= 0 && (steps.empty() || time >= steps.back().time);
+		steps.push_back(step);
+	}
+	fclose(file);
+	if (!valid)
+		fprintf(stderr, "%s:%d : not a scenario step, or out of order\n", path, lineNumber);
+	return valid;
+}
+
+// The keys, mouse buttons and joystick buttons, for the game, with the time
+// each came. GLFW's callbacks push them, after AntTweakBar has seen them.
+InputQueue inputQueue;
+// Presses the game took, and how long after they came, for the statistics
+unsigned long long inputPresses = 0;
+double inputDelayMs = 0.0;
+
+void keyCallback(GLFWwindow *, int key, int, int action, int mods)
+{
+	if (TwEventKeyGLFW(key, action))
+		redrawRequested = true;
+	InputEvent event = { getTime(), INPUT_KEY, key, action, mods };
+	pushInputEvent(inputQueue, event);
+}
+
+void charCallback(GLFWwindow *, unsigned int codepoint)
+{
+	if (TwEventCharGLFW((int)codepoint, GLFW_PRESS))
+		redrawRequested = true;
+}
+
+void mouseButtonCallback(GLFWwindow * window, int button, int action, int mods)
+{
+	if (TwEventMouseButtonGLFW(window, button, action, mods))
+		redrawRequested = true;
+	InputEvent event = { getTime(), INPUT_MOUSE_BUTTON, button, action, mods };
+	pushInputEvent(inputQueue, event);
+}
+
+void cursorPosCallback(GLFWwindow * window, double x, double y)
+{
+	bool overGui = TwEventMousePosGLFW(window, x, y) != 0;
+	if (overGui || mouseOverGui)
+		redrawRequested = true;
+	mouseOverGui = overGui;
+}
+
+void scrollCallback(GLFWwindow * window, double x, double y)
+{
+	if (TwEventMouseWheelGLFW(window, x, y))
+		redrawRequested = true;
+}
+
+void windowRefreshCallback(GLFWwindow *)
+{
+	redrawRequested = true;
+}
+
+// GLFW has no joystick callback : the buttons of the first joystick are
+// compared with the last poll, and each change is queued at the poll's time.
+// There is nothing to poll before the window, nor without GLFW.
+unsigned char joystickButtons[32];
+int joystickButtonCount = 0;
+
+void pollJoystick()
+{
+	if (!window)
+		return;
+	int count = 0;
+	const unsigned char * buttons = NULL;
+	if (glfwJoystickPresent(GLFW_JOYSTICK_1))
+		buttons = glfwGetJoystickButtons(GLFW_JOYSTICK_1, &count);
+	count = std::min(count, 32);
+	double now = getTime();
+	for (int i = 0; i < count; i++) {
+		unsigned char last = i < joystickButtonCount ? joystickButtons[i] : (unsigned char)GLFW_RELEASE;
+		if (buttons[i] != last) {
+			InputEvent event = { now, INPUT_JOYSTICK_BUTTON, i, buttons[i], 0 };
+			pushInputEvent(inputQueue, event);
+		}
+		joystickButtons[i] = buttons[i];
+	}
+	joystickButtonCount = count;
+}
+
+// ------------------------------------------------------  PASSO FIXO ---------------------------------------------------------------
+// The game and the camera advance in steps of this length, whatever the
+// frame rate; the frames show the camera between the last two steps
+const double simulationStep = 1.0 / 120.0;
+
+// Sleeps until glfwGetTime() reaches deadline. The scheduler can wake up a
+// couple of milliseconds late, so the end of the wait is spun instead.
+void waitUntil(double deadline)
+{
+	for (;;) {
+		double remaining = deadline - glfwGetTime();
+		if (remaining <= 0.0)
+			return;
+		if (remaining > 0.002)
+			std::this_thread::sleep_for(std::chrono::duration<double>(remaining - 0.002));
+		else
+			std::this_thread::yield();
+	}
+}
+
 // ------------------------------------------------------    INT MAIN    -----------------------------------------------------------------
-int main( void )
+int main( int argc, char *argv[] )
 {
-	// Initialise GLFW
-	if( !glfwInit() )
-	{
-		fprintf( stderr, "Failed to initialize GLFW\n" );
-		getchar();
-		return -1;
+	// Asset loading benchmarks : print the timings and quit
+	bool serialLoad = false;
+	bool benchmarkGLCalls = false;
+	bool compareQuantization = false;
+	bool benchmarkDDS = false;
+	bool benchmarkShaders = false;
+	bool benchmarkShading = false;
+	bool benchmarkLights = false;
+	bool countGLCalls = false;
+	bool multiDraw = true;
+	bool sortDraws = true;
+	bool frustumCulling = true;
+	bool depthPrepass = false;
+	bool benchmarkDepth = false;
+	bool continuousRendering = false;
+	double maxFps = 0.0; // No cap
+	int headlessWidth = 1024, headlessHeight = 768;
+	int headlessFrames = 300;
+	const char * scenarioPath = NULL;
+	const char * dumpPattern = NULL; // printf pattern of the frame's number
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--serial-load") == 0)
+			serialLoad = true;
+		if (strcmp(argv[i], "--split-16bit") == 0)
+			meshLoadFlags |= MESH_SPLIT_16BIT;
+		if (strcmp(argv[i], "--optimize-overdraw") == 0)
+			meshLoadFlags |= MESH_OPTIMIZE_OVERDRAW;
+		if (strcmp(argv[i], "--no-lods") == 0) {
+			meshLoadFlags &= ~MESH_GENERATE_LODS;
+			lodPixelError = 0.0f;
+		}
+		if (strcmp(argv[i], "--benchmark-gl-calls") == 0)
+			benchmarkGLCalls = true;
+		if (strcmp(argv[i], "--quantize-vertices") == 0)
+			quantizeVertices = true;
+		if (strcmp(argv[i], "--compare-quantization") == 0)
+			compareQuantization = true;
+		if (strcmp(argv[i], "--separate-textures") == 0)
+			separateTextures = true;
+		if (strcmp(argv[i], "--benchmark-dds") == 0)
+			benchmarkDDS = true;
+		if (strcmp(argv[i], "--benchmark-shaders") == 0)
+			benchmarkShaders = true;
+		if (strcmp(argv[i], "--benchmark-shading") == 0)
+			benchmarkShading = true;
+		if (strcmp(argv[i], "--benchmark-lights") == 0)
+			benchmarkLights = true;
+		if (strcmp(argv[i], "--benchmark-depth-prepass") == 0)
+			benchmarkDepth = true;
+		if (strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+		if (strcmp(argv[i], "--continuous") == 0)
+			continuousRendering = true;
+		if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+			maxFps = atof(argv[++i]);
+		if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc
+			&& (sscanf(argv[++i], "%dx%d", &headlessWidth, &headlessHeight) != 2 || headlessWidth <= 0 || headlessHeight <= 0)) {
+			fprintf(stderr, "--size : width x height, 1024x768 for instance\n");
+			return -1;
+		}
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			headlessFrames = atoi(argv[++i]);
+		if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc)
+			scenarioPath = argv[++i];
+		if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc && !isDumpPattern(dumpPattern = argv[++i])) {
+			fprintf(stderr, "--dump-frames : a file name with one %%d for the frame's number, frame%%04d.png for instance\n");
+			return -1;
+		}
+		if (strcmp(argv[i], "--unlit") == 0)
+			unlitShading = true;
+		if (strcmp(argv[i], "--count-gl-calls") == 0)
+			countGLCalls = true;
+		if (strcmp(argv[i], "--no-multi-draw") == 0)
+			multiDraw = false;
+		if (strcmp(argv[i], "--no-sort-draws") == 0)
+			sortDraws = false;
+		if (strcmp(argv[i], "--no-culling") == 0)
+			frustumCulling = false;
+		if (strcmp(argv[i], "--test-large-mesh") == 0)
+			return testLargeMesh() ? 0 : 1;
+		if (strcmp(argv[i], "--benchmark-mesh-cache") == 0) {
+			benchmarkMeshCache(objFiles, sizeof(objFiles) / sizeof(objFiles[0]), meshLoadFlags);
+			return 0;
+		}
+		if (strcmp(argv[i], "--benchmark-obj-loader") == 0) {
+			benchmarkOBJLoader(objFiles, sizeof(objFiles) / sizeof(objFiles[0]));
+			return 0;
+		}
+		if (strcmp(argv[i], "--benchmark-indexvbo") == 0) {
+			benchmarkIndexVBO(objFiles, sizeof(objFiles) / sizeof(objFiles[0]));
+			return 0;
+		}
+		if (strcmp(argv[i], "--benchmark-mesh-optimizer") == 0) {
+			benchmarkMeshOptimizer(objFiles, sizeof(objFiles) / sizeof(objFiles[0]));
+			return 0;
+		}
 	}
-	glfwWindowHint(GLFW_SAMPLES, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	// Open a window and create its OpenGL context
-
-	window = glfwCreateWindow( 1024, 768, "Game Genius - CPII", NULL, NULL);
-	if( window == NULL ){
-		fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
-		getchar();
-		glfwTerminate();
+
+	std::vector<ScenarioStep> scenario;
+	if (scenarioPath && !loadScenario(scenarioPath, scenario))
 		return -1;
-	}
+	// With no window GLFW is not initialised; glfwTerminate does nothing then
+	OffscreenContext offscreen;
+	if (headless) {
+		if (!createOffscreenContext(offscreen))
+			return -1;
+	} else {
+		// Initialise GLFW
+		if( !glfwInit() )
+		{
+			fprintf( stderr, "Failed to initialize GLFW\n" );
+			getchar();
+			return -1;
+		}
+		glfwWindowHint(GLFW_SAMPLES, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		// Open a window and create its OpenGL context
+
+		window = glfwCreateWindow( 1024, 768, "Game Genius - CPII", NULL, NULL);
+		if( window == NULL ){
+			fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
 
-	glfwMakeContextCurrent(window);
+		glfwMakeContextCurrent(window);
+	}
 	// Initialize GLEW
 	glewExperimental = true; // Needed for core profile
 	if (glewInit() != GLEW_OK) {
@@ -204,9 +708,19 @@ int main( void )
 		glfwTerminate();
 		return -1;
 	}
+	// The frames of --headless go to a framebuffer object of this size
+	OffscreenTarget offscreenTarget;
+	if (headless && !createOffscreenTarget(offscreenTarget, headlessWidth, headlessHeight)) {
+		fprintf(stderr, "Cannot draw into a %dx%d framebuffer\n", headlessWidth, headlessHeight);
+		deleteOffscreenContext(offscreen);
+		return -1;
+	}
 	// Initialize the GUI
 	TwInit(TW_OPENGL_CORE, NULL);
-	TwWindowSize(1024, 768);
+	if (headless)
+		TwWindowSize(headlessWidth, headlessHeight);
+	else
+		TwWindowSize(1024, 768);
 	TwBar * EulerGUI = TwNewBar("Euler settings");
 	TwSetParam(EulerGUI, NULL, "refresh", TW_PARAM_CSTRING, 1, "0.1");
 
@@ -217,22 +731,26 @@ int main( void )
 	TwAddVarRW(EulerGUI, "Pos Y"  , TW_TYPE_FLOAT, &gPosition1.y, "step=0.1");
 	TwAddVarRW(EulerGUI, "Pos Z"  , TW_TYPE_FLOAT, &gPosition1.z, "step=0.1");
 
-	// Set GLFW event callbacks. I removed glfwSetWindowSizeCallback for conciseness
-	glfwSetMouseButtonCallback(window, (GLFWmousebuttonfun)TwEventMouseButtonGLFW); // - Directly redirect GLFW mouse button events to AntTweakBar
-	glfwSetCursorPosCallback(window, (GLFWcursorposfun)TwEventMousePosGLFW);          // - Directly redirect GLFW mouse position events to AntTweakBar
-	glfwSetScrollCallback(window, (GLFWscrollfun)TwEventMouseWheelGLFW);    // - Directly redirect GLFW mouse wheel events to AntTweakBar
-	glfwSetKeyCallback(window, (GLFWkeyfun)TwEventKeyGLFW);                         // - Directly redirect GLFW key events to AntTweakBar
-	glfwSetCharCallback(window, (GLFWcharfun)TwEventCharGLFW);                      // - Directly redirect GLFW char events to AntTweakBar
+	createInputQueue(inputQueue);
+	if (!headless) {
+		// Set GLFW event callbacks. I removed glfwSetWindowSizeCallback for conciseness
+		glfwSetMouseButtonCallback(window, mouseButtonCallback); // - Redirect GLFW mouse button events to AntTweakBar, redrawing what it handles
+		glfwSetCursorPosCallback(window, cursorPosCallback);     // - Redirect GLFW mouse position events to AntTweakBar
+		glfwSetScrollCallback(window, scrollCallback);           // - Redirect GLFW mouse wheel events to AntTweakBar
+		glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+		glfwSetKeyCallback(window, keyCallback);                 // - Redirect GLFW key events to AntTweakBar, then to the game's input queue
+		glfwSetCharCallback(window, charCallback);               // - Redirect GLFW char events to AntTweakBar
 
 
-	// Ensure we can capture the escape key being pressed below
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
-    // Hide the mouse and enable unlimited mouvement
-    //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_ENABLED);
+		// Ensure we can capture the escape key being pressed below
+		glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+		// Hide the mouse and enable unlimited mouvement
+		//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_ENABLED);
 
-    // Set the mouse at the center of the screen
-    glfwPollEvents();
-    glfwSetCursorPos(window, 1024/2, 768/2);
+		// Set the mouse at the center of the screen
+		glfwPollEvents();
+		glfwSetCursorPos(window, 1024/2, 768/2);
+	}
 
 	// Dark blue background
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -245,318 +763,215 @@ int main( void )
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programID = LoadShaders( "StandardShading.vertexshader", "StandardShading.fragmentshader" );
-
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-	GLuint ViewMatrixID = glGetUniformLocation(programID, "V");
-	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
-
-	// Load the texture
-	GLuint mesaTexture = loadDDS("mesa.dds");
-	GLuint botaoAmareloTexture = loadDDS("botaoAmarelo.dds");
-	GLuint botaoAzulTexture = loadDDS("botaoAzul.dds");
-	GLuint botaoVerdeTexture = loadDDS("botaoVerde.dds");
-	GLuint botaoVermelhoTexture = loadDDS("botaoVermelho.dds");
-	GLuint botaoAmareloDireitoTexture = loadDDS("botaoAmareloDireito.dds");
-	GLuint botaoVermelhoMeioTexture = loadDDS("botaoVermelhoMeio.dds");
-	GLuint botaoAmareloEsquerdoTexture = loadDDS("botaoAmareloEsquerdo.dds");
-	GLuint meioRestoJogoTexture = loadDDS("meioRestoJogo.dds");
-	GLuint restoJogoTexture = loadDDS("restoJogo.dds");
-	GLuint telaInicialTexture = loadDDS("telaInicial.dds");
-
-	// Get a handle for our "myTextureSampler" uniform
-	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
+	// Create and compile our GLSL programs from the shaders, one per variant
+	Shading shading;
+	if (!loadShading(shading, "StandardShading.vertexshader", "StandardShading.fragmentshader")) {
+		fprintf(stderr, "Failed to load the shaders\n");
+		getchar();
+		deleteShading(shading);
+		TwTerminate();
+		glfwTerminate();
+		return -1;
+	}
+	// Every variant has the same attribute locations
+	meshAttributes = shading.lit.attributes;
+	shading.multiDraw = shading.multiDraw && multiDraw;
+	shading.sortDraws = sortDraws;
+	shading.depthPrepass = depthPrepass;
+	// Switched at run time, to compare the GPU time of both
+	TwAddVarRW(EulerGUI, "Depth pre-pass", TW_TYPE_BOOLCPP, &shading.depthPrepass, "");
+
+	// Need the GL context : print the GL calls per frame, the quantized rendering differences, the texture, shader load, shading, light list or depth pre-pass times, and quit
+	if (benchmarkGLCalls || compareQuantization || benchmarkDDS || benchmarkShaders || benchmarkShading || benchmarkLights || benchmarkDepth) {
+		if (benchmarkGLCalls)
+			benchmarkMeshBinding(objFiles, sizeof(objFiles) / sizeof(objFiles[0]), meshLoadFlags, shading.lit.program);
+		if (compareQuantization)
+			compareMeshQuantization(objFiles, sizeof(objFiles) / sizeof(objFiles[0]), meshLoadFlags, shading);
+		if (benchmarkDDS)
+			benchmarkDDSLoader(ddsFiles, sizeof(ddsFiles) / sizeof(ddsFiles[0]));
+		if (benchmarkShaders)
+			benchmarkShaderCache("StandardShading.vertexshader", "StandardShading.fragmentshader");
+		if (benchmarkShading)
+			benchmarkShadingVariants(shading);
+		if (benchmarkLights)
+			benchmarkLightList(shading);
+		if (benchmarkDepth)
+			benchmarkDepthPrepass(shading);
+		deleteShading(shading);
+		TwTerminate();
+		glfwTerminate();
+		return 0;
+	}
+
+	// The textures are loaded with the meshes below
+	TextureLayer mesaTexture;
+	TextureLayer botaoAmareloTexture;
+	TextureLayer botaoAzulTexture;
+	TextureLayer botaoVerdeTexture;
+	TextureLayer botaoVermelhoTexture;
+	TextureLayer botaoAmareloDireitoTexture;
+	TextureLayer botaoVermelhoMeioTexture;
+	TextureLayer botaoAmareloEsquerdoTexture;
+	TextureLayer meioRestoJogoTexture;
+	TextureLayer restoJogoTexture;
+	TextureLayer telaInicialTexture;
 
 	// Read our .obj file
 	//------------------------------------------------------------------  LOAD OBJETOS ---------------------------------------------------------
 	//------ ENTER TO START --------------------------------------------------------------------------------------------------------------------
-	std::vector<glm::vec3> telaInicialVertices;
-	std::vector<glm::vec2> telaInicialUvs;
-	std::vector<glm::vec3> telaInicialNormals;
-	std::vector<unsigned short> telaInicialIndices;
-	std::vector<glm::vec3> telaInicialIndexedVertices;
-	std::vector<glm::vec2> telaInicialIndexedUvs;
-	std::vector<glm::vec3> telaInicialIndexedNormals;
-	GLuint telaInicialVertexbuffer;
-	GLuint telaInicialUvbuffer;
-	GLuint telaInicialNormalbuffer;
-	GLuint telaInicialElementbuffer;
-	bool telaInicial = loadOBJ("telaInicial.obj", telaInicialVertices, telaInicialUvs, telaInicialNormals);
-	// chama load buffers e cria buffer para o botao tal;
-	indexVBO(telaInicialVertices, telaInicialUvs, telaInicialNormals, telaInicialIndices, telaInicialIndexedVertices, telaInicialIndexedUvs, telaInicialIndexedNormals);
-	loadBuffers(
-		telaInicialIndices,
-		telaInicialIndexedVertices,
-		telaInicialIndexedUvs,
-		telaInicialIndexedNormals,
-		&telaInicialVertexbuffer,
-		&telaInicialUvbuffer,
-		&telaInicialNormalbuffer,
-		&telaInicialElementbuffer
-	);
+	Mesh telaInicialMesh;
 	// ----------------------------------------------------------- BOTAO AMARELO ---------------------------------------------------------------
-	std::vector<glm::vec3> botaoAmareloVertices;
-	std::vector<glm::vec2> botaoAmareloUvs;
-	std::vector<glm::vec3> botaoAmareloNormals;
-	std::vector<unsigned short> botaoAmareloIndices;
-	std::vector<glm::vec3> botaoAmareloIndexedVertices;
-	std::vector<glm::vec2> botaoAmareloIndexedUvs;
-	std::vector<glm::vec3> botaoAmareloIndexedNormals;
-	GLuint botaoAmareloVertexbuffer;
-	GLuint botaoAmareloUvbuffer;
-	GLuint botaoAmareloNormalbuffer;
-	GLuint botaoAmareloElementbuffer;
-	bool botaoAmarelo = loadOBJ("botaoAmarelo.obj", botaoAmareloVertices, botaoAmareloUvs, botaoAmareloNormals);
-	// chama load buffers e cria buffer para o botao tal;
-	indexVBO(botaoAmareloVertices, botaoAmareloUvs, botaoAmareloNormals, botaoAmareloIndices, botaoAmareloIndexedVertices, botaoAmareloIndexedUvs, botaoAmareloIndexedNormals);
-	loadBuffers(
-		botaoAmareloIndices,
-		botaoAmareloIndexedVertices,
-		botaoAmareloIndexedUvs,
-		botaoAmareloIndexedNormals,
-		&botaoAmareloVertexbuffer,
-		&botaoAmareloUvbuffer,
-		&botaoAmareloNormalbuffer,
-		&botaoAmareloElementbuffer
-	);
+	Mesh botaoAmareloMesh;
 	// ------------------------------------------------------------ BOTAO AZUL ----------------------------------------------------------------
-	std::vector<glm::vec3> botaoAzulVertices;
-	std::vector<glm::vec2> botaoAzulUvs;
-	std::vector<glm::vec3> botaoAzulNormals;
-	std::vector<unsigned short> botaoAzulIndices;
-	std::vector<glm::vec3> botaoAzulIndexedVertices;
-	std::vector<glm::vec2> botaoAzulIndexedUvs;
-	std::vector<glm::vec3> botaoAzulIndexedNormals;
-	GLuint botaoAzulVertexbuffer;
-	GLuint botaoAzulUvbuffer;
-	GLuint botaoAzulNormalbuffer;
-	GLuint botaoAzulElementbuffer;
-	bool botaoAzul = loadOBJ("botaoAzul.obj", botaoAzulVertices, botaoAzulUvs, botaoAzulNormals);
-	indexVBO(botaoAzulVertices, botaoAzulUvs, botaoAzulNormals, botaoAzulIndices, botaoAzulIndexedVertices, botaoAzulIndexedUvs, botaoAzulIndexedNormals);
-	loadBuffers(
-		botaoAzulIndices,
-		botaoAzulIndexedVertices,
-		botaoAzulIndexedUvs,
-		botaoAzulIndexedNormals,
-		&botaoAzulVertexbuffer,
-		&botaoAzulUvbuffer,
-		&botaoAzulNormalbuffer,
-		&botaoAzulElementbuffer
-	);
+	Mesh botaoAzulMesh;
 	// ---------------------------------------------------------- BOTAO VERDE ------------------------------------------------------------------
 	// BOTAO VERDE
-	std::vector<glm::vec3> botaoVerdeVertices;
-	std::vector<glm::vec2> botaoVerdeUvs;
-	std::vector<glm::vec3> botaoVerdeNormals;
-	std::vector<unsigned short> botaoVerdeIndices;
-	std::vector<glm::vec3> botaoVerdeIndexedVertices;
-	std::vector<glm::vec2> botaoVerdeIndexedUvs;
-	std::vector<glm::vec3> botaoVerdeIndexedNormals;
-	GLuint botaoVerdeVertexbuffer;
-	GLuint botaoVerdeUvbuffer;
-	GLuint botaoVerdeNormalbuffer;
-	GLuint botaoVerdeElementbuffer;
-	bool botaoVerde = loadOBJ("botaoVerde.obj", botaoVerdeVertices, botaoVerdeUvs, botaoVerdeNormals);
-	indexVBO(botaoVerdeVertices, botaoVerdeUvs, botaoVerdeNormals, botaoVerdeIndices, botaoVerdeIndexedVertices, botaoVerdeIndexedUvs, botaoVerdeIndexedNormals);
-	loadBuffers(
-		botaoVerdeIndices,
-		botaoVerdeIndexedVertices,
-		botaoVerdeIndexedUvs,
-		botaoVerdeIndexedNormals,
-		&botaoVerdeVertexbuffer,
-		&botaoVerdeUvbuffer,
-		&botaoVerdeNormalbuffer,
-		&botaoVerdeElementbuffer
-	);
+	Mesh botaoVerdeMesh;
 	// --------------------------------------------------------- BOTAO VERMELHO ----------------------------------------------------------------
-	std::vector<glm::vec3> botaoVermelhoVertices;
-	std::vector<glm::vec2> botaoVermelhoUvs;
-	std::vector<glm::vec3> botaoVermelhoNormals;
-	std::vector<unsigned short> botaoVermelhoIndices;
-	std::vector<glm::vec3> botaoVermelhoIndexedVertices;
-	std::vector<glm::vec2> botaoVermelhoIndexedUvs;
-	std::vector<glm::vec3> botaoVermelhoIndexedNormals;
-	GLuint botaoVermelhoVertexbuffer;
-	GLuint botaoVermelhoUvbuffer;
-	GLuint botaoVermelhoNormalbuffer;
-	GLuint botaoVermelhoElementbuffer;
-	bool botaoVermelho = loadOBJ("botaoVermelho.obj", botaoVermelhoVertices, botaoVermelhoUvs, botaoVermelhoNormals);
-	indexVBO(botaoVermelhoVertices, botaoVermelhoUvs, botaoVermelhoNormals, botaoVermelhoIndices, botaoVermelhoIndexedVertices, botaoVermelhoIndexedUvs, botaoVermelhoIndexedNormals);
-	loadBuffers(
-		botaoVermelhoIndices,
-		botaoVermelhoIndexedVertices,
-		botaoVermelhoIndexedUvs,
-		botaoVermelhoIndexedNormals,
-		&botaoVermelhoVertexbuffer,
-		&botaoVermelhoUvbuffer,
-		&botaoVermelhoNormalbuffer,
-		&botaoVermelhoElementbuffer
-	);
+	Mesh botaoVermelhoMesh;
 	// -----------------------------------------------   BOTAO AMARELO ESQUERDO   -------------------------------------------------------------
-	std::vector<glm::vec3> botaoAmareloEsquerdoVertices;
-	std::vector<glm::vec2> botaoAmareloEsquerdoUvs;
-	std::vector<glm::vec3> botaoAmareloEsquerdoNormals;
-	std::vector<unsigned short> botaoAmareloEsquerdoIndices;
-	std::vector<glm::vec3> botaoAmareloEsquerdoIndexedVertices;
-	std::vector<glm::vec2> botaoAmareloEsquerdoIndexedUvs;
-	std::vector<glm::vec3> botaoAmareloEsquerdoIndexedNormals;
-	GLuint botaoAmareloEsquerdoVertexbuffer;
-	GLuint botaoAmareloEsquerdoUvbuffer;
-	GLuint botaoAmareloEsquerdoNormalbuffer;
-	GLuint botaoAmareloEsquerdoElementbuffer;
-	bool botaoAmareloEsquerdo = loadOBJ("botaoAmareloEsquerdo.obj", botaoAmareloEsquerdoVertices, botaoAmareloEsquerdoUvs, botaoAmareloEsquerdoNormals);
-	indexVBO(botaoAmareloEsquerdoVertices, botaoAmareloEsquerdoUvs, botaoAmareloEsquerdoNormals, botaoAmareloEsquerdoIndices, botaoAmareloEsquerdoIndexedVertices, botaoAmareloEsquerdoIndexedUvs, botaoAmareloEsquerdoIndexedNormals);
-	loadBuffers(
-		botaoAmareloEsquerdoIndices,
-		botaoAmareloEsquerdoIndexedVertices,
-		botaoAmareloEsquerdoIndexedUvs,
-		botaoAmareloEsquerdoIndexedNormals,
-		&botaoAmareloEsquerdoVertexbuffer,
-		&botaoAmareloEsquerdoUvbuffer,
-		&botaoAmareloEsquerdoNormalbuffer,
-		&botaoAmareloEsquerdoElementbuffer
-	);
+	Mesh botaoAmareloEsquerdoMesh;
 	// -----------------------------------------------   BOTAO AMARELO DIREITO  -------------------------------------------------------------
-	std::vector<glm::vec3> botaoAmareloDireitoVertices;
-	std::vector<glm::vec2> botaoAmareloDireitoUvs;
-	std::vector<glm::vec3> botaoAmareloDireitoNormals;
-	std::vector<unsigned short> botaoAmareloDireitoIndices;
-	std::vector<glm::vec3> botaoAmareloDireitoIndexedVertices;
-	std::vector<glm::vec2> botaoAmareloDireitoIndexedUvs;
-	std::vector<glm::vec3> botaoAmareloDireitoIndexedNormals;
-	GLuint botaoAmareloDireitoVertexbuffer;
-	GLuint botaoAmareloDireitoUvbuffer;
-	GLuint botaoAmareloDireitoNormalbuffer;
-	GLuint botaoAmareloDireitoElementbuffer;
-	bool botaoAmareloDireito = loadOBJ("botaoAmareloDireito.obj", botaoAmareloDireitoVertices, botaoAmareloDireitoUvs, botaoAmareloDireitoNormals);
-	indexVBO(botaoAmareloDireitoVertices, botaoAmareloDireitoUvs, botaoAmareloDireitoNormals, botaoAmareloDireitoIndices, botaoAmareloDireitoIndexedVertices, botaoAmareloDireitoIndexedUvs, botaoAmareloDireitoIndexedNormals);
-	loadBuffers(
-		botaoAmareloDireitoIndices,
-		botaoAmareloDireitoIndexedVertices,
-		botaoAmareloDireitoIndexedUvs,
-		botaoAmareloDireitoIndexedNormals,
-		&botaoAmareloDireitoVertexbuffer,
-		&botaoAmareloDireitoUvbuffer,
-		&botaoAmareloDireitoNormalbuffer,
-		&botaoAmareloDireitoElementbuffer
-	);
+	Mesh botaoAmareloDireitoMesh;
 	// --------------------------------------------------   BOTAO VERMELHO MEIO  -------------------------------------------------------------
-	std::vector<glm::vec3> botaoVermelhoMeioVertices;
-	std::vector<glm::vec2> botaoVermelhoMeioUvs;
-	std::vector<glm::vec3> botaoVermelhoMeioNormals;
-	std::vector<unsigned short> botaoVermelhoMeioIndices;
-	std::vector<glm::vec3> botaoVermelhoMeioIndexedVertices;
-	std::vector<glm::vec2> botaoVermelhoMeioIndexedUvs;
-	std::vector<glm::vec3> botaoVermelhoMeioIndexedNormals;
-	GLuint botaoVermelhoMeioVertexbuffer;
-	GLuint botaoVermelhoMeioUvbuffer;
-	GLuint botaoVermelhoMeioNormalbuffer;
-	GLuint botaoVermelhoMeioElementbuffer;
-	bool botaoVermelhoMeio = loadOBJ("botaoVermelhoMeio.obj", botaoVermelhoMeioVertices, botaoVermelhoMeioUvs, botaoVermelhoMeioNormals);
-	indexVBO(botaoVermelhoMeioVertices, botaoVermelhoMeioUvs, botaoVermelhoMeioNormals, botaoVermelhoMeioIndices, botaoVermelhoMeioIndexedVertices, botaoVermelhoMeioIndexedUvs, botaoVermelhoMeioIndexedNormals);
-	loadBuffers(
-		botaoVermelhoMeioIndices,
-		botaoVermelhoMeioIndexedVertices,
-		botaoVermelhoMeioIndexedUvs,
-		botaoVermelhoMeioIndexedNormals,
-		&botaoVermelhoMeioVertexbuffer,
-		&botaoVermelhoMeioUvbuffer,
-		&botaoVermelhoMeioNormalbuffer,
-		&botaoVermelhoMeioElementbuffer
-	);
+	Mesh botaoVermelhoMeioMesh;
 	// ------------------------------------------------------------- MESA -------------------------------------------------------------------
-	std::vector<glm::vec3> mesaVertices;
-	std::vector<glm::vec2> mesaUvs;
-	std::vector<glm::vec3> mesaNormals;
-	std::vector<unsigned short> mesaIndices;
-	std::vector<glm::vec3> mesaIndexedVertices;
-	std::vector<glm::vec2> mesaIndexedUvs;
-	std::vector<glm::vec3> mesaIndexedNormals;
-	GLuint mesaVertexbuffer;
-	GLuint mesaUvbuffer;
-	GLuint mesaNormalbuffer;
-	GLuint mesaElementbuffer;
-	bool mesa = loadOBJ("mesa.obj", mesaVertices, mesaUvs, mesaNormals);
-	indexVBO(mesaVertices, mesaUvs, mesaNormals, mesaIndices, mesaIndexedVertices, mesaIndexedUvs, mesaIndexedNormals);
-	loadBuffers(
-		mesaIndices,
-		mesaIndexedVertices,
-		mesaIndexedUvs,
-		mesaIndexedNormals,
-		&mesaVertexbuffer,
-		&mesaUvbuffer,
-		&mesaNormalbuffer,
-		&mesaElementbuffer
-	);
+	Mesh mesaMesh;
 	// --------------------------------------------------------- resto jogo ------------------------------------------------------------------
-	std::vector<glm::vec3> restoJogoVertices;
-	std::vector<glm::vec2> restoJogoUvs;
-	std::vector<glm::vec3> restoJogoNormals;
-	std::vector<unsigned short> restoJogoIndices;
-	std::vector<glm::vec3> restoJogoIndexedVertices;
-	std::vector<glm::vec2> restoJogoIndexedUvs;
-	std::vector<glm::vec3> restoJogoIndexedNormals;
-	GLuint restoJogoVertexbuffer;
-	GLuint restoJogoUvbuffer;
-	GLuint restoJogoNormalbuffer;
-	GLuint restoJogoElementbuffer;
-	bool restoJogo = loadOBJ("restoJogo.obj", restoJogoVertices, restoJogoUvs, restoJogoNormals);
-	indexVBO(restoJogoVertices, restoJogoUvs, restoJogoNormals, restoJogoIndices, restoJogoIndexedVertices, restoJogoIndexedUvs, restoJogoIndexedNormals);
-	loadBuffers(
-		restoJogoIndices,
-		restoJogoIndexedVertices,
-		restoJogoIndexedUvs,
-		restoJogoIndexedNormals,
-		&restoJogoVertexbuffer,
-		&restoJogoUvbuffer,
-		&restoJogoNormalbuffer,
-		&restoJogoElementbuffer
-	);
+	Mesh restoJogoMesh;
 	// ---------------------------------------------------- BOTAO MEIO RESTO JOGO --------------------------------------------------------------
-	std::vector<glm::vec3> meioRestoJogoVertices;
-	std::vector<glm::vec2> meioRestoJogoUvs;
-	std::vector<glm::vec3> meioRestoJogoNormals;
-	std::vector<unsigned short> meioRestoJogoIndices;
-	std::vector<glm::vec3> meioRestoJogoIndexedVertices;
-	std::vector<glm::vec2> meioRestoJogoIndexedUvs;
-	std::vector<glm::vec3> meioRestoJogoIndexedNormals;
-	GLuint meioRestoJogoVertexbuffer;
-	GLuint meioRestoJogoUvbuffer;
-	GLuint meioRestoJogoNormalbuffer;
-	GLuint meioRestoJogoElementbuffer;
-	bool meioRestoJogo = loadOBJ("meioRestoJogo.obj", meioRestoJogoVertices, meioRestoJogoUvs, meioRestoJogoNormals);
-	indexVBO(meioRestoJogoVertices, meioRestoJogoUvs, meioRestoJogoNormals, meioRestoJogoIndices, meioRestoJogoIndexedVertices, meioRestoJogoIndexedUvs, meioRestoJogoIndexedNormals);
-	loadBuffers(
-		meioRestoJogoIndices,
-		meioRestoJogoIndexedVertices,
-		meioRestoJogoIndexedUvs,
-		meioRestoJogoIndexedNormals,
-		&meioRestoJogoVertexbuffer,
-		&meioRestoJogoUvbuffer,
-		&meioRestoJogoNormalbuffer,
-		&meioRestoJogoElementbuffer
-	);
+	Mesh meioRestoJogoMesh;
+
+	// The OBJ and DDS files are read on the worker threads, the GL uploads are done here
+	TextureLoad textureLoads[] = {
+		textureLoad("mesa.dds", &mesaTexture),
+		textureLoad("botaoAmarelo.dds", &botaoAmareloTexture),
+		textureLoad("botaoAzul.dds", &botaoAzulTexture),
+		textureLoad("botaoVerde.dds", &botaoVerdeTexture),
+		textureLoad("botaoVermelho.dds", &botaoVermelhoTexture),
+		textureLoad("botaoAmareloDireito.dds", &botaoAmareloDireitoTexture),
+		textureLoad("botaoVermelhoMeio.dds", &botaoVermelhoMeioTexture),
+		textureLoad("botaoAmareloEsquerdo.dds", &botaoAmareloEsquerdoTexture),
+		textureLoad("meioRestoJogo.dds", &meioRestoJogoTexture),
+		textureLoad("restoJogo.dds", &restoJogoTexture),
+		textureLoad("telaInicial.dds", &telaInicialTexture),
+	};
+	// The meshes' objects in the culling scene, added in the order of meshLoads
+	enum {
+		telaInicialObject, botaoAmareloObject, botaoAzulObject, botaoVerdeObject, botaoVermelhoObject,
+		botaoAmareloEsquerdoObject, botaoAmareloDireitoObject, botaoVermelhoMeioObject,
+		mesaObject, restoJogoObject, meioRestoJogoObject, objectCount
+	};
+	MeshLoad meshLoads[objectCount] = {
+		meshLoad("telaInicial.obj", &telaInicialMesh),
+		meshLoad("botaoAmarelo.obj", &botaoAmareloMesh),
+		meshLoad("botaoAzul.obj", &botaoAzulMesh),
+		meshLoad("botaoVerde.obj", &botaoVerdeMesh),
+		meshLoad("botaoVermelho.obj", &botaoVermelhoMesh),
+		meshLoad("botaoAmareloEsquerdo.obj", &botaoAmareloEsquerdoMesh, true, vec3(-0.015f, 0.0f, 0.033f)),
+		meshLoad("botaoAmareloDireito.obj", &botaoAmareloDireitoMesh, true, vec3(0.035f, 0.0f, 0.033f)),
+		meshLoad("botaoVermelhoMeio.obj", &botaoVermelhoMeioMesh, true, vec3(0.015f, 0.0f, 0.033f)),
+		meshLoad("mesa.obj", &mesaMesh, true),
+		meshLoad("restoJogo.obj", &restoJogoMesh, true),
+		meshLoad("meioRestoJogo.obj", &meioRestoJogoMesh, true),
+	};
+	int textureCount = sizeof(textureLoads) / sizeof(textureLoads[0]);
+	int meshCount = sizeof(meshLoads) / sizeof(meshLoads[0]);
+
+	std::chrono::steady_clock::time_point assetLoadStart = std::chrono::steady_clock::now();
+	unsigned int loadThreads = 0;
+	createPixelUnpackRing(textureUploadRing);
+	createResourceCache(resourceCache);
+	createTextureArray(textureArray, separateTextures ? 0 : countDistinctTextures(textureLoads, textureCount));
+	if (serialLoad)
+		loadAssetsSerial(meshLoads, meshCount, textureLoads, textureCount);
+	else
+		loadThreads = loadAssetsParallel(meshLoads, meshCount, textureLoads, textureCount);
+	deletePixelUnpackRing(textureUploadRing);
+	double assetLoadMs = elapsedMs(assetLoadStart);
+
+	// The sum of the per-asset times is what the serial path would take
+	double assetWorkMs = 0.0;
+	for (int i = 0; i < meshCount; i++)
+		assetWorkMs += meshLoads[i].readMs + meshLoads[i].uploadMs;
+	for (int i = 0; i < textureCount; i++)
+		assetWorkMs += textureLoads[i].readMs + textureLoads[i].uploadMs;
+	if (serialLoad)
+		printf("Loaded %d meshes and %d textures in %.2f ms (serial)\n", meshCount, textureCount, assetLoadMs);
+	else
+		printf("Loaded %d meshes and %d textures in %.2f ms on %u threads, %.2f ms of work : %.2fx faster than the serial path\n",
+			meshCount, textureCount, assetLoadMs, loadThreads, assetWorkMs, assetWorkMs / assetLoadMs);
+	printf("Resource cache : %u of %u assets shared with an identical file, %.1f KB deduplicated\n",
+		resourceCache.shared, resourceCache.loads, resourceCache.sharedBytes / 1024.0);
+
+	// The scenery never moves on the board : one vertex and index buffer for all of it,
+	// the small buttons moved to their place once. The four buttons light up, they stay apart.
+	std::vector<const IndexedMesh *> staticMeshes;
+	std::vector<glm::mat4> staticTransforms;
+	for (int i = 0; i < meshCount; i++)
+		if (meshLoads[i].merge) {
+			staticMeshes.push_back(&meshLoads[i].data);
+			staticTransforms.push_back(translate(mat4(), meshLoads[i].batchOffset));
+		}
+	StaticBatch staticBatch;
+	createStaticBatch(&staticMeshes[0], &staticTransforms[0], (int)staticMeshes.size(), meshAttributes, staticBatch, quantizeVertices);
+	for (int i = 0, part = 0; i < meshCount; i++)
+		if (meshLoads[i].merge) {
+			*meshLoads[i].mesh = staticBatch.parts[part++];
+			releaseMeshData(meshLoads[i].data);
+		}
+	printf("Static batch : %d meshes, %u vertices, %u triangles, %.1f KB\n", (int)staticBatch.parts.size(),
+		staticBatch.merged.vertexCount, staticBatch.merged.lods[0].indexCount / 3,
+		(staticBatch.merged.vertexCount * staticBatch.merged.vertexSize
+			+ staticBatch.merged.indexCount * (staticBatch.merged.indexType == GL_UNSIGNED_INT ? 4 : 2)) / 1024.0);
+
+	// The board's meshes in one vertex and index buffer, drawn together when the GL can;
+	// without multi draw every mesh keeps drawing from its own
+	std::vector<Mesh *> arenaMeshes;
+	for (int i = 0; i < meshCount; i++)
+		arenaMeshes.push_back(meshLoads[i].mesh);
+	MeshArena meshArena;
+	createMeshArena(meshArena, &arenaMeshes[0], meshCount, meshAttributes, SHADING_MAX_DRAWS);
+	printf("Mesh arena : %u meshes, %.1f KB, %s\n", meshArena.meshCount,
+		(meshArena.vertexCount * meshArena.vertexSize + meshArena.indexCount * sizeof(unsigned short)) / 1024.0,
+		shading.multiDraw ? "glMultiDrawElementsIndirect" : "one draw per mesh");
+
+	// Every mesh is an object of the culling scene, placed by the board's model matrix;
+	// meshLoads[i] is object i
+	CullingScene cullingScene;
+	createCullingScene(cullingScene);
+	for (int i = 0; i < meshCount; i++)
+		addCullingObject(cullingScene, *meshLoads[i].mesh, mat4());
 	// ------------------------------------------------------------------- FIM LOAD --------------------------------------------------------------
 
-	// Get a handle for our "LightPosition" uniform
-	glUseProgram(programID);
-	GLuint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
-	GLuint botaoAmareloLightID = glGetUniformLocation(programID, "botaoAmareloLightPosition");
-	GLuint botaoAzulLightID = glGetUniformLocation(programID, "botaoAzulLightPosition");
-	GLuint botaoVerdeLightID = glGetUniformLocation(programID, "botaoVerdeLightPosition");
-	GLuint botaoVermelhoLightID = glGetUniformLocation(programID, "botaoVermelhoLightPosition");
+	// The button lights : each one only lights its own button, while it is on
+	glm::vec3 botaoAmareloLightPos = glm::vec3(0.7, 3.4, -1.45);
+	glm::vec3 botaoAzulLightPos = glm::vec3(0.7, 3.4, -0.45);
+	glm::vec3 botaoVerdeLightPos = glm::vec3(-0.45, 3.5, -1.55);
+	glm::vec3 botaoVermelhoLightPos = glm::vec3(-0.4, 3.4, -0.4);
+
+	glm::vec3 botaoAmareloLightColor = glm::vec3(1, 1, 0);
+	glm::vec3 botaoAzulLightColor = glm::vec3(0, 0, 1);
+	glm::vec3 botaoVerdeLightColor = glm::vec3(0, 1, 0);
+	glm::vec3 botaoVermelhoLightColor = glm::vec3(1, 0, 0);
 
-	GLuint botaoAmareloLightPowerID = glGetUniformLocation(programID, "botaoAmareloLightPower");
-	GLuint botaoAzulLightPowerID = glGetUniformLocation(programID, "botaoAzulLightPower");
-	GLuint botaoVerdeLightPowerID = glGetUniformLocation(programID, "botaoVerdeLightPower");
-	GLuint botaoVermelhoLightPowerID = glGetUniformLocation(programID, "botaoVermelhoLightPower");
+	float botaoAmareloLightPower = 0.0f;
+	float botaoAzulLightPower = 0.0f;
+	float botaoVerdeLightPower = 0.0f;
+	float botaoVermelhoLightPower = 0.0f;
+
+	// Far enough to light the whole button under the light; the other draws
+	// do not take it, so that a pressed button leaves its neighbours and the
+	// table dark
+	float botaoLightRadius = 2.0f;
+	enum { botaoAmareloLight = 1, botaoAzulLight, botaoVerdeLight, botaoVermelhoLight };
 
 	// For speed computationS
-	double lastTime = glfwGetTime();
-	double lastFrameTime = lastTime;
+	double lastTime = getTime();
 	int nbFrames = 0;
+	// Process CPU time, every thread, to show what an idle second costs
+	double lastCpuTime = (double)std::clock() / CLOCKS_PER_SEC;
+	FrameState drawnState = FrameState();
 
 	glm::vec3 cameraFrontPosition = glm::vec3(0, 5, 15);
 	glm::vec3 cameraBackPosition = glm::vec3(0, 5, -15);
@@ -584,10 +999,10 @@ int main( void )
 	bool keyRightPressed = false;
 	bool keyLeftPressed = false;
 
-	double pKeyTimePressed;
-	double telaInicialKeyTimePressed;
-	double direcoesKeyTimePressed;
-	double luzLigadaTimePassed;
+	double pKeyTimePressed = 0.0;
+	double telaInicialKeyTimePressed = 0.0;
+	double direcoesKeyTimePressed = 0.0;
+	double luzLigadaTimePassed = 0.0;
 
 	double luzBotaoLigada = 2.0f;
 	double luzBotaoDesligada = 0.0f;
@@ -605,95 +1020,75 @@ int main( void )
 	std::queue<int> corSelecionadaJogo;
 	std::queue<int> corSelecionadaJogador;
 
-	do {
-		// Measure speed
-		double currentTime = glfwGetTime();
-		float deltaTime = (float)(currentTime - lastFrameTime);
-		lastFrameTime = currentTime;
-		nbFrames++;
-		if ( currentTime - lastTime >= 1.0 ) {
-			printf("%f ms/frame\n", 1000.0/double(nbFrames));
-			nbFrames = 0;
-			lastTime += 1.0;
-		}
-
-        glm::vec3 botaoAmareloLightPos = glm::vec3(0, 0, 0);
-        glUniform3f(botaoAmareloLightID, botaoAmareloLightPos.x, botaoAmareloLightPos.y, botaoAmareloLightPos.z);
-
-        glm::vec3 botaoAzulLightPos = glm::vec3(0, 0, 0);
-        glUniform3f(botaoAzulLightID, botaoAzulLightPos.x, botaoAzulLightPos.y, botaoAzulLightPos.z);
-
-        glm::vec3 botaoVerdeLightPos = glm::vec3(0, 0, 0);
-        glUniform3f(botaoVerdeLightID, botaoVerdeLightPos.x, botaoVerdeLightPos.y, botaoVerdeLightPos.z);
-
-        glm::vec3 botaoVermelhoLightPos = glm::vec3(0, 0, 0);
-        glUniform3f(botaoVermelhoLightID, botaoVermelhoLightPos.x, botaoVermelhoLightPos.y, botaoVermelhoLightPos.z);
-
-		// Clear the screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Use our shader
-		glUseProgram(programID);
-		if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && !renderTelaInicial) {
-			telaInicialKeyTimePressed = glfwGetTime();
+	// The time of the last step of the game
+	double simulationTime = getTime();
+	// The camera at the step before, the frames are drawn between the two
+	glm::vec3 previousCameraPosition = cameraPosition;
+	glm::vec3 previousCameraLookTo = cameraLookTo;
+	// Set by a step that moves the camera at once : nothing to draw in between
+	bool cameraCut = false;
+	// The sequence colour a step lit on its timer, until a frame shows it
+	double sequenceScheduled = 0.0;
+	double sequenceStepped = 0.0;
+	double sequenceWorstMs = 0.0;
+	// For --max-fps
+	double lastPresent = getTime();
+
+	// ------------------------------------------------------  PASSO DO JOGO -----------------------------------------------------------------
+	// One step of the game at currentTime, simulationStep after the last one
+	auto stepGame = [&](double currentTime) {
+		const float deltaTime = (float)simulationStep;
+
+		if (getKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && !renderTelaInicial) {
+			telaInicialKeyTimePressed = currentTime;
 			renderTelaInicial = true;
 			cameraPosition = cameraTopPosition;
 			cameraLookTo = cameraTopLookTo;
+			cameraCut = true;
 		}
 
-		glm::mat4 ViewMatrix = glm::lookAt(
-			cameraPosition, // Camera is here
-			cameraLookTo, // and looks here
-			cameraHead  // Head is up (set to 0,-1,0 to look upside-down)
-		);
-
-		glm::vec3 lightPos = glm::vec3(0, 3, 18);
-		glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-
 		if (renderTelaInicial && !gameOver && pontuacao < 1000) {
-			if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+			if (getKey(window, GLFW_KEY_P) == GLFW_PRESS) {
 				if (!pKeyTimePressed || (currentTime - pKeyTimePressed) > 0.4) {
 					visualizarOrtho = !visualizarOrtho;
-					pKeyTimePressed = glfwGetTime();
+					pKeyTimePressed = currentTime;
 				}
 			}
 
-			if (visualizarOrtho) {
-				ProjectionMatrix = ortogonalProjection;
-			} else {
-				ProjectionMatrix = perspectiveProjection;
-			}
-
-			if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS) {
+			if (getKey(window, GLFW_KEY_F1) == GLFW_PRESS) {
 				animacao = false;
 				cameraPosition = cameraFrontPosition;
 				cameraLookTo = cameraNormalLookTo;
 				cameraHead = cameraHeadNormal;
+				cameraCut = true;
 				gPosition1.z = 0.5f;
 			}
 
-			if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS) {
+			if (getKey(window, GLFW_KEY_F2) == GLFW_PRESS) {
 				animacao = false;
 				cameraPosition = cameraTopPosition;
 				cameraLookTo = cameraTopLookTo;
 				cameraHead = cameraHeadNormal;
+				cameraCut = true;
 				gPosition1.z = 0.0f;
 			}
 
-			if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS) {
+			if (getKey(window, GLFW_KEY_F3) == GLFW_PRESS) {
 				animacao = false;
 				cameraPosition = cameraBackPosition;
 				cameraLookTo = cameraNormalLookTo;
 				cameraHead = cameraHeadNormal;
+				cameraCut = true;
 				gPosition1.z = 0.5f;
 			}
 
-			if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && ((currentTime - telaInicialKeyTimePressed) > 1)) {
+			if (getKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && ((currentTime - telaInicialKeyTimePressed) > 1)) {
 				animacao = true;
 				zSomar = false;
 				cameraPosition = cameraFrontPosition;
 				cameraLookTo = cameraNormalLookTo;
 				cameraHead = cameraHeadNormal;
+				cameraCut = true;
 
 			}
 
@@ -726,56 +1121,46 @@ int main( void )
 						cameraPosition = cameraFrontPosition;
 						cameraLookTo = cameraNormalLookTo;
 						cameraHead = cameraHeadNormal;
+						cameraCut = true;
 					}
 				}
 			}
 
 			if (todosBotoesExibidos) {
 				if (!luzLigadaTimePassed || (currentTime - luzLigadaTimePassed) > 1.5) {
-					glUniform1f(botaoAmareloLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoAzulLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoVerdeLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoVermelhoLightPowerID, luzBotaoDesligada);
-				}
-
-				// Amarelo
-				if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS 
-					&& (!direcoesKeyTimePressed || (currentTime - direcoesKeyTimePressed) > 0.2)
-				) {
-					keyUpPressed = true;
-					direcoesKeyTimePressed = glfwGetTime();
-					corSelecionadaJogador.push(1);
-					glUniform1f(botaoAmareloLightPowerID, luzBotaoLigada);
-				}
-
-				// Vermelho
-				if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS 
-					&& (!direcoesKeyTimePressed || (currentTime - direcoesKeyTimePressed) > 0.2)
-				) {
-					keyDownPressed = true;
-					direcoesKeyTimePressed = glfwGetTime();
-					corSelecionadaJogador.push(4);
-					glUniform1f(botaoVermelhoLightPowerID, luzBotaoLigada);
-				}
-
-				// Azul
-				if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS 
-					&& (!direcoesKeyTimePressed || (currentTime - direcoesKeyTimePressed) > 0.2)
-				) {
-					keyRightPressed = true;
-					direcoesKeyTimePressed = glfwGetTime();
-					corSelecionadaJogador.push(2);
-					glUniform1f(botaoAzulLightPowerID, luzBotaoLigada);
+					botaoAmareloLightPower = luzBotaoDesligada;
+					botaoAzulLightPower = luzBotaoDesligada;
+					botaoVerdeLightPower = luzBotaoDesligada;
+					botaoVermelhoLightPower = luzBotaoDesligada;
 				}
 
-				// Verde
-				if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS 
-					&& (!direcoesKeyTimePressed || (currentTime - direcoesKeyTimePressed) > 0.2)
-				) {
-					keyLeftPressed = true;
-					direcoesKeyTimePressed = glfwGetTime();
-					corSelecionadaJogador.push(3);
-					glUniform1f(botaoVerdeLightPowerID, luzBotaoLigada);
+				// The presses up to this step, in order, each at its own time :
+				// two presses within a frame are two colours
+				InputEvent event;
+				while (peekInputEvent(inputQueue, event) && event.time <= currentTime) {
+					popInputEvent(inputQueue);
+					int cor = corDoEvento(event);
+					if (!cor) {
+						continue;
+					}
+					direcoesKeyTimePressed = event.time;
+					corSelecionadaJogador.push(cor);
+					inputPresses++;
+					inputDelayMs += 1000.0 * (getTime() - event.time);
+
+					if (cor == 1) { // Amarelo
+						keyUpPressed = true;
+						botaoAmareloLightPower = luzBotaoLigada;
+					} else if (cor == 4) { // Vermelho
+						keyDownPressed = true;
+						botaoVermelhoLightPower = luzBotaoLigada;
+					} else if (cor == 2) { // Azul
+						keyRightPressed = true;
+						botaoAzulLightPower = luzBotaoLigada;
+					} else { // Verde
+						keyLeftPressed = true;
+						botaoVerdeLightPower = luzBotaoLigada;
+					}
 				}
 
 				if ((keyUpPressed || keyDownPressed || keyRightPressed || keyLeftPressed)
@@ -791,305 +1176,358 @@ int main( void )
 						gameOver = true;
 					}
 				} else if (direcoesKeyTimePressed && (currentTime - direcoesKeyTimePressed) > 1.0) {
-					glUniform1f(botaoAmareloLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoAzulLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoVerdeLightPowerID, luzBotaoDesligada);
-					glUniform1f(botaoVermelhoLightPowerID, luzBotaoDesligada);
+					botaoAmareloLightPower = luzBotaoDesligada;
+					botaoAzulLightPower = luzBotaoDesligada;
+					botaoVerdeLightPower = luzBotaoDesligada;
+					botaoVermelhoLightPower = luzBotaoDesligada;
 				}
 			} else if (corSelecionadaJogo.size() < totalBotoes && 
 				(!luzLigadaTimePassed || (currentTime - luzLigadaTimePassed) >= 1.5)
 			) {
+				// Played on its timer : how late it is shown is logged
+				if (luzLigadaTimePassed && currentTime - simulationStep < luzLigadaTimePassed + 1.5) {
+					sequenceScheduled = luzLigadaTimePassed + 1.5;
+					sequenceStepped = currentTime;
+				}
 				corSelecionadaJogo.push(sortearCor(corSelecionadaJogo.empty() ? 0 : corSelecionadaJogo.back()));
 
-				glUniform1f(botaoAmareloLightPowerID, corSelecionadaJogo.back() == 1 ? luzBotaoLigada : luzBotaoDesligada);
-				glUniform1f(botaoAzulLightPowerID, corSelecionadaJogo.back() == 2 ? luzBotaoLigada : luzBotaoDesligada);
-				glUniform1f(botaoVerdeLightPowerID, corSelecionadaJogo.back() == 3 ? luzBotaoLigada : luzBotaoDesligada);
-				glUniform1f(botaoVermelhoLightPowerID, corSelecionadaJogo.back() == 4 ? luzBotaoLigada : luzBotaoDesligada);
-				luzLigadaTimePassed = glfwGetTime();
+				botaoAmareloLightPower = corSelecionadaJogo.back() == 1 ? luzBotaoLigada : luzBotaoDesligada;
+				botaoAzulLightPower = corSelecionadaJogo.back() == 2 ? luzBotaoLigada : luzBotaoDesligada;
+				botaoVerdeLightPower = corSelecionadaJogo.back() == 3 ? luzBotaoLigada : luzBotaoDesligada;
+				botaoVermelhoLightPower = corSelecionadaJogo.back() == 4 ? luzBotaoLigada : luzBotaoDesligada;
+				luzLigadaTimePassed = currentTime;
+			}
+
+			if (corSelecionadaJogo.size() == totalBotoes) {
+				todosBotoesExibidos = !todosBotoesExibidos;
+			}
+		}
+
+		// Out of the player's turn the presses are not the game's. In the turn,
+		// the steps where todosBotoesExibidos is false leave them to the next.
+		if (!renderTelaInicial || gameOver || corSelecionadaJogo.size() != totalBotoes)
+			dropInputEvents(inputQueue, currentTime);
+	};
+
+	// --headless draws every frame, and times them
+	size_t scenarioNext = 0;
+	int headlessFrame = 0;
+	std::vector<double> headlessFrameMs;
+	if (headless) {
+		continuousRendering = true;
+		headlessFrameMs.reserve(headlessFrames);
+	}
+
+	// Only the GL entry points GLEW loads are counted, see glcalls.hpp
+	if (countGLCalls)
+		startCountingGLCalls();
+
+	do {
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		// The scenario's steps up to this frame. A key goes to the input
+		// queue too, at its own time, as GLFW's callback would send it.
+		bool dumpFrame = dumpPattern != NULL;
+		for (; headless && scenarioNext < scenario.size() && scenario[scenarioNext].time <= headlessTime; scenarioNext++) {
+			const ScenarioStep & step = scenario[scenarioNext];
+			if (step.key < 0) {
+				dumpFrame = true;
+				continue;
 			}
+			headlessKeys[step.key] = step.action == GLFW_PRESS;
+			InputEvent event = { step.time, INPUT_KEY, step.key, step.action, 0 };
+			pushInputEvent(inputQueue, event);
+		}
+
+		// Measure speed
+		double currentTime = getTime();
+		if ( currentTime - lastTime >= 1.0 ) {
+			// An idle second draws nothing, and should cost next to no CPU.
+			// --headless counts the seconds of its own clock : no CPU time.
+			double cpuTime = (double)std::clock() / CLOCKS_PER_SEC;
+			if (headless)
+				printf("%d frames drawn\n", nbFrames);
+			else
+				printf("%d frames drawn, %.1f%% CPU\n", nbFrames, 100.0 * (cpuTime - lastCpuTime) / (currentTime - lastTime));
+			lastCpuTime = cpuTime;
+			if (inputPresses > 0 || inputQueue.dropped.load() > 0) {
+				printf("%llu presses, %.3f ms from press to step, %u input events dropped\n", inputPresses,
+					inputPresses > 0 ? inputDelayMs / inputPresses : 0.0, inputQueue.dropped.exchange(0));
+				inputPresses = 0;
+				inputDelayMs = 0.0;
+			}
+			if (nbFrames > 0) {
+				printf("%f ms/frame, %llu triangles/frame (%llu at full detail), %llu texture binds/frame for %llu textures, %llu program changes/frame, %llu draw calls/frame, %.3f ms submit/frame, %llu state changes/frame (%llu redundant skipped)\n", 1000.0/double(nbFrames),
+					meshDrawStats.triangles / nbFrames, meshDrawStats.fullDetailTriangles / nbFrames,
+					textureBindStats.binds / nbFrames, textureBindStats.layers / nbFrames, shadingStats.programChanges / nbFrames,
+					shadingStats.drawCalls / nbFrames, shadingStats.submitMs / nbFrames,
+					glStateStats.calls / nbFrames, glStateStats.skipped / nbFrames);
+				printf("%.3f ms GPU/frame%s\n", shadingStats.gpuFrames > 0 ? shadingStats.gpuMs / shadingStats.gpuFrames : 0.0,
+					shading.depthPrepass ? " with the depth pre-pass" : "");
+				if (frustumCulling && cullingStats.queries > 0) {
+					printf("%llu of %llu objects culled/frame, %.3f ms culling/frame\n",
+						cullingStats.culled / cullingStats.queries, cullingStats.objects / cullingStats.queries, cullingStats.cullMs / cullingStats.queries);
+					cullingStats = CullingStats();
+				}
+				meshDrawStats.triangles = 0;
+				meshDrawStats.fullDetailTriangles = 0;
+				textureBindStats.binds = 0;
+				textureBindStats.layers = 0;
+				glStateStats.calls = 0;
+				glStateStats.skipped = 0;
+				if (countGLCalls) {
+					printf("%llu GL calls/frame, %llu uniform buffer uploads/frame\n",
+						countedGLCalls() / nbFrames, shadingStats.bufferUploads / nbFrames);
+					resetGLCallCount();
+				}
+				shadingStats = ShadingStats();
+			}
+			nbFrames = 0;
+			lastTime += 1.0;
+		}
+
+		// The levels of detail are picked for the framebuffer's height
+		int viewportWidth = headlessWidth, viewportHeight = headlessHeight;
+		if (!headless)
+			glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+
+		// TwDraw binds its own textures and uses its own program
+		resetGLState();
+
+		pollJoystick();
+
+		// Every step due by now, then the camera as far between the last two as
+		// the time is. A slow frame runs several steps, a fast one none.
+		while (simulationTime + simulationStep <= currentTime) {
+			previousCameraPosition = cameraPosition;
+			previousCameraLookTo = cameraLookTo;
+			simulationTime += simulationStep;
+			cameraCut = false;
+			stepGame(simulationTime);
+			if (cameraCut) {
+				previousCameraPosition = cameraPosition;
+				previousCameraLookTo = cameraLookTo;
+			}
+		}
+		float alpha = (float)((currentTime - simulationTime) / simulationStep);
+		glm::vec3 viewPosition = glm::mix(previousCameraPosition, cameraPosition, alpha);
+		glm::vec3 viewLookTo = glm::mix(previousCameraLookTo, cameraLookTo, alpha);
+
+		glm::mat4 ViewMatrix = glm::lookAt(
+			viewPosition, // Camera is here
+			viewLookTo, // and looks here
+			cameraHead  // Head is up (set to 0,-1,0 to look upside-down)
+		);
+
+		// The draws are recorded, then drawShadingFrame uploads their data and draws them
+		beginShadingFrame(shading);
+		// Every piece of the board has the same model matrix, the small buttons are only moved on top of it
+		glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
+		glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
+		glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
+		glm::mat4 boardModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
+
+		for (int i = 0; i < meshCount; i++)
+			moveCullingObject(cullingScene, i, boardModelMatrix);
+		// The scene is culled at the first draw, once the projection of the frame is known;
+		// only the objects in view are recorded
+		bool sceneCulled = false;
+		auto drawObject = [&](int object, const TextureLayer & texture, int light, unsigned int pointLightOwner = 0) {
+			if (frustumCulling) {
+				if (!sceneCulled) {
+					cullScene(cullingScene, ProjectionMatrix * ViewMatrix);
+					sceneCulled = true;
+				}
+				if (!cullingScene.visible[object])
+					return;
+			}
+			const Mesh & mesh = *cullingScene.objects[object].mesh;
+			addShadingDraw(shading, mesh, selectMeshLod(mesh, ProjectionMatrix, ViewMatrix, boardModelMatrix, (float)viewportHeight, lodPixelError), texture, boardModelMatrix, light, unlitShading, pointLightOwner);
+		};
+
+		glm::vec3 lightPos = glm::vec3(0, 3, 18);
+		int light = addShadingLight(shading, lightPos, glm::vec3(1, 1, 1), 100.0f);
+
+		if (renderTelaInicial && !gameOver && pontuacao < 1000) {
+			if (visualizarOrtho) {
+				ProjectionMatrix = ortogonalProjection;
+			} else {
+				ProjectionMatrix = perspectiveProjection;
+			}
+
+			// Each button lights itself only
+			addShadingPointLight(shading, botaoAmareloLightPos, botaoAmareloLightColor, botaoAmareloLightPower, botaoLightRadius, botaoAmareloLight);
+			addShadingPointLight(shading, botaoAzulLightPos, botaoAzulLightColor, botaoAzulLightPower, botaoLightRadius, botaoAzulLight);
+			addShadingPointLight(shading, botaoVerdeLightPos, botaoVerdeLightColor, botaoVerdeLightPower, botaoLightRadius, botaoVerdeLight);
+			addShadingPointLight(shading, botaoVermelhoLightPos, botaoVermelhoLightColor, botaoVermelhoLightPower, botaoLightRadius, botaoVermelhoLight);
 
 			// -------------------------------------------------------------------  DRAW OBJETOS -----------------------------------------------------
 			//--------------- draw botao amarelo ----------------------------------------------------------------------------------------------------
-            botaoAmareloLightPos = glm::vec3(0.7, 3.4, -1.45);
-            glUniform3f(botaoAmareloLightID, botaoAmareloLightPos.x, botaoAmareloLightPos.y, botaoAmareloLightPos.z);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoAmareloTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoAmareloVertexbuffer, botaoAmareloUvbuffer, botaoAmareloNormalbuffer, botaoAmareloElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoAmareloIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
-            botaoAmareloLightPos = glm::vec3(0, 0, 0);
-            glUniform3f(botaoAmareloLightID, botaoAmareloLightPos.x, botaoAmareloLightPos.y, botaoAmareloLightPos.z);
+			drawObject(botaoAmareloObject, botaoAmareloTexture, light, botaoAmareloLight);
 
 			//--------------- draw botao azul --------------------------------------------------------------------------------------------------------
-            botaoAzulLightPos = glm::vec3(0.7, 3.4, -0.45);
-            glUniform3f(botaoAzulLightID, botaoAzulLightPos.x, botaoAzulLightPos.y, botaoAzulLightPos.z);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoAzulTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoAzulVertexbuffer, botaoAzulUvbuffer, botaoAzulNormalbuffer, botaoAzulElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoAzulIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
-            botaoAzulLightPos = glm::vec3(0, 0, 0);
-            glUniform3f(botaoAzulLightID, botaoAzulLightPos.x, botaoAzulLightPos.y, botaoAzulLightPos.z);
+			drawObject(botaoAzulObject, botaoAzulTexture, light, botaoAzulLight);
 
 			//--------------- draw botao verde -------------------------------------------------------------------------------------------------------
-            botaoVerdeLightPos = glm::vec3(-0.45, 3.5, -1.55);
-            glUniform3f(botaoVerdeLightID, botaoVerdeLightPos.x, botaoVerdeLightPos.y, botaoVerdeLightPos.z);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoVerdeTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoVerdeVertexbuffer, botaoVerdeUvbuffer, botaoVerdeNormalbuffer, botaoVerdeElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoVerdeIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
-            botaoVerdeLightPos = glm::vec3(0, 0, 0);
-            glUniform3f(botaoVerdeLightID, botaoVerdeLightPos.x, botaoVerdeLightPos.y, botaoVerdeLightPos.z);
+			drawObject(botaoVerdeObject, botaoVerdeTexture, light, botaoVerdeLight);
 
 			//--------------- draw botao vermelho ----------------------------------------------------------------------------------------------------
-            botaoVermelhoLightPos = glm::vec3(-0.4, 3.4, -0.4);
-            glUniform3f(botaoVermelhoLightID, botaoVermelhoLightPos.x, botaoVermelhoLightPos.y, botaoVermelhoLightPos.z);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoVermelhoTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoVermelhoVertexbuffer, botaoVermelhoUvbuffer, botaoVermelhoNormalbuffer, botaoVermelhoElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoVermelhoIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
-            botaoVermelhoLightPos = glm::vec3(0, 0, 0);
-            glUniform3f(botaoVermelhoLightID, botaoVermelhoLightPos.x, botaoVermelhoLightPos.y, botaoVermelhoLightPos.z);
+			drawObject(botaoVermelhoObject, botaoVermelhoTexture, light, botaoVermelhoLight);
 
             lightPos = glm::vec3(1, 11, -1);
-			glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
+			light = addShadingLight(shading, lightPos, glm::vec3(1, 1, 1), 100.0f);
 
 			//---------------   draw mesa inteira ----------------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, mesaTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(mesaVertexbuffer, mesaUvbuffer, mesaNormalbuffer, mesaElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, mesaIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(mesaObject, mesaTexture, light);
 
 			//--------------- draw botaozinho esquerdo ----------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoAmareloEsquerdoTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoAmareloEsquerdoVertexbuffer, botaoAmareloEsquerdoUvbuffer, botaoAmareloEsquerdoNormalbuffer, botaoAmareloEsquerdoElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				vec3 botaozinhoAmareloEsquerdoPosition = gPosition1;
-				// gPosition1 = (-0.5f, -1.0f, 0.5f);
-				botaozinhoAmareloEsquerdoPosition.x -= 0.015f;
-				botaozinhoAmareloEsquerdoPosition.z += 0.033f;
-				glm::mat4 TranslationMatrix = translate(mat4(), botaozinhoAmareloEsquerdoPosition); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoAmareloEsquerdoIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(botaoAmareloEsquerdoObject, botaoAmareloEsquerdoTexture, light);
 
 			//--------------- draw botaozinho direito ------------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoAmareloDireitoTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoAmareloDireitoVertexbuffer, botaoAmareloDireitoUvbuffer, botaoAmareloDireitoNormalbuffer, botaoAmareloDireitoElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				vec3 botaozinhoAmareloDireitoPosition = gPosition1;
-				botaozinhoAmareloDireitoPosition.x += 0.035f;
-				botaozinhoAmareloDireitoPosition.z += 0.033f;
-				glm::mat4 TranslationMatrix = translate(mat4(), botaozinhoAmareloDireitoPosition); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoAmareloDireitoIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(botaoAmareloDireitoObject, botaoAmareloDireitoTexture, light);
 
 			//--------------- draw botaozinho central ------------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, botaoVermelhoMeioTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(botaoVermelhoMeioVertexbuffer, botaoVermelhoMeioUvbuffer, botaoVermelhoMeioNormalbuffer, botaoVermelhoMeioElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				vec3 botaoVermelhoMeioPosition = gPosition1;
-				botaoVermelhoMeioPosition.x += 0.015f;
-				botaoVermelhoMeioPosition.z += 0.033f;
-				glm::mat4 TranslationMatrix = translate(mat4(), botaoVermelhoMeioPosition); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, botaoVermelhoMeioIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(botaoVermelhoMeioObject, botaoVermelhoMeioTexture, light);
 
 			//--------------- draw resto do jogo externo ---------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, restoJogoTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(restoJogoVertexbuffer, restoJogoUvbuffer, restoJogoNormalbuffer, restoJogoElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, restoJogoIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(restoJogoObject, restoJogoTexture, light);
 
 			//--------------- draw circulo do centro jogo --------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, meioRestoJogoTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(meioRestoJogoVertexbuffer, meioRestoJogoUvbuffer, meioRestoJogoNormalbuffer, meioRestoJogoElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, meioRestoJogoIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
-
-			if (corSelecionadaJogo.size() == totalBotoes) {
-				todosBotoesExibidos = !todosBotoesExibidos;
-			}
+			drawObject(meioRestoJogoObject, meioRestoJogoTexture, light);
 		} else if (!gameOver && pontuacao < 1000) {
 			//---------------  draw enter to renderTelaInicial --------------------------------------------------------------------------------------------
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, telaInicialTexture);
-			glUniform1i(TextureID, 0);
-			bindBuffer(telaInicialVertexbuffer, telaInicialUvbuffer, telaInicialNormalbuffer, telaInicialElementbuffer, programID);
-			{
-				glm::mat4 RotationMatrix = eulerAngleYXZ(gOrientation1.y, gOrientation1.x, gOrientation1.z);
-				glm::mat4 TranslationMatrix = translate(mat4(), gPosition1); // A bit to the left
-				glm::mat4 ScalingMatrix = scale(mat4(), vec3(1.0f, 1.0f, 1.0f));
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix * ScalingMatrix;
-				glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-				glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-				glDrawElements(GL_TRIANGLES, telaInicialIndices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-			}
+			drawObject(telaInicialObject, telaInicialTexture, light);
 		} else if (gameOver && pontuacao < 1000) {
 			printf("Fim de Jogo. Você foi derrotado!\n");
 		} else {
 			printf("Fim de Jogo. Vitória!\n");
 		}
 		//---------------   FIM DOS DRAWS OBJETOS   -------------------------------------------------------------------------------------------
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-		// Draw GUI
-		TwDraw();
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		FrameState frameState;
+		frameState.cameraPosition = viewPosition;
+		frameState.cameraLookTo = viewLookTo;
+		frameState.cameraHead = cameraHead;
+		frameState.boardPosition = gPosition1;
+		frameState.boardOrientation = gOrientation1;
+		frameState.lightPowers[0] = botaoAmareloLightPower;
+		frameState.lightPowers[1] = botaoAzulLightPower;
+		frameState.lightPowers[2] = botaoVerdeLightPower;
+		frameState.lightPowers[3] = botaoVermelhoLightPower;
+		frameState.ortho = visualizarOrtho;
+		frameState.renderTelaInicial = renderTelaInicial;
+		frameState.todosBotoesExibidos = todosBotoesExibidos;
+		frameState.gameOver = gameOver;
+		frameState.pontuacao = pontuacao;
+		frameState.sequence = (int)corSelecionadaJogo.size();
+		frameState.played = (int)corSelecionadaJogador.size();
+		frameState.depthPrepass = shading.depthPrepass;
+		frameState.width = viewportWidth;
+		frameState.height = viewportHeight;
+
+		if (continuousRendering || redrawRequested || !sameFrameState(frameState, drawnState)) {
+			drawnState = frameState;
+			redrawRequested = false;
+			nbFrames++;
+			// The benchmarks bind their own framebuffers
+			if (headless)
+				glBindFramebuffer(GL_FRAMEBUFFER, offscreenTarget.framebuffer);
+			// Clear the screen
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawShadingFrame(shading, ViewMatrix, ProjectionMatrix, viewportWidth, viewportHeight);
+			glBindVertexArray(0);
+			// Draw GUI
+			TwDraw();
+			if (maxFps > 0.0 && !headless)
+				waitUntil(lastPresent + 1.0 / maxFps);
+			lastPresent = getTime();
+			if (headless) {
+				// Read back, or finished : the frame's time is all of its work
+				if (dumpFrame) {
+					char path[1024];
+					snprintf(path, sizeof(path), dumpPattern ? dumpPattern : "frame%04d.ppm", headlessFrame);
+					readOffscreenTarget(offscreenTarget);
+					writeOffscreenImage(offscreenTarget, path);
+				} else {
+					glFinish();
+				}
+				headlessFrameMs.push_back(elapsedMs(frameStart));
+				headlessFrame++;
+				headlessTime += headlessFrameTime;
+			} else {
+			// Swap buffers
+				glfwSwapBuffers(window);
+				glfwPollEvents();
+			}
+			if (sequenceScheduled) {
+				double shownMs = 1000.0 * (getTime() - sequenceScheduled);
+				sequenceWorstMs = std::max(sequenceWorstMs, shownMs);
+				printf("Sequence colour %d : stepped %.3f ms, shown %.3f ms after its time (worst %.3f ms)\n", (int)corSelecionadaJogo.size(),
+					1000.0 * (sequenceStepped - sequenceScheduled), shownMs, sequenceWorstMs);
+				sequenceScheduled = 0.0;
+			}
+		} else {
+			// Nothing changed : sleep until an event, or until the game's next timer
+			// (the sequence, the repeat delays of P and Enter, the end of a turn) or the
+			// next statistics line, a step late so that a step has passed the timer
+			const double timers[] = {
+				luzLigadaTimePassed + 1.5, direcoesKeyTimePressed + 1.0,
+				pKeyTimePressed + 0.4, telaInicialKeyTimePressed + 1.0
+			};
+			double now = getTime();
+			double wakeUp = lastTime + 1.0;
+			for (double timer : timers)
+				if (timer > simulationTime && timer < wakeUp)
+					wakeUp = timer;
+			// A press still queued is taken at the next step; a joystick
+			// wakes nothing up, it is polled at 60 Hz
+			InputEvent pending;
+			if (peekInputEvent(inputQueue, pending))
+				wakeUp = now;
+			else if (joystickButtonCount > 0)
+				wakeUp = std::min(wakeUp, now + 1.0 / 60.0);
+			glfwWaitEventsTimeout(std::max(wakeUp - now, 0.0) + simulationStep);
+		}
 	} // Check if the ESC key was pressed or the window was closed
 
 	// ----------------------------------------------------    WHILE    ------------------------------------------------------------
 	while(
-		glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS && glfwWindowShouldClose(window) == 0
+		getKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS
+		&& (headless ? headlessFrame < headlessFrames : glfwWindowShouldClose(window) == 0)
 	);
 
+	if (headless && !headlessFrameMs.empty()) {
+		std::vector<double> sorted = headlessFrameMs;
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (double ms : sorted)
+			total += ms;
+		size_t n = sorted.size();
+		printf("%d frames of %dx%d : %.3f ms/frame average (%.1f frames/s), %.3f min, %.3f median, %.3f 95th percentile, %.3f 99th percentile, %.3f max\n",
+			(int)n, headlessWidth, headlessHeight, total / n, 1000.0 * n / total,
+			sorted[0], sorted[n / 2], sorted[n * 95 / 100], sorted[n * 99 / 100], sorted[n - 1]);
+	}
+
 	// ----------------------------------------------------Cleanup VBO and shader------------------------------------------------------------
-	deleteBuffers(botaoAmareloVertexbuffer, botaoAmareloUvbuffer, botaoAmareloNormalbuffer, botaoAmareloElementbuffer);
-	deleteBuffers(botaoAzulVertexbuffer, botaoAzulUvbuffer, botaoAzulNormalbuffer, botaoAzulElementbuffer);
-	deleteBuffers(botaoVerdeVertexbuffer, botaoVerdeUvbuffer, botaoVerdeNormalbuffer, botaoVerdeElementbuffer);
-	deleteBuffers(botaoVermelhoVertexbuffer, botaoVermelhoUvbuffer, botaoVermelhoNormalbuffer, botaoVermelhoElementbuffer);
-	deleteBuffers(botaoAmareloEsquerdoVertexbuffer, botaoAmareloEsquerdoUvbuffer, botaoAmareloEsquerdoNormalbuffer, botaoAmareloEsquerdoElementbuffer);
-	deleteBuffers(botaoAmareloDireitoVertexbuffer, botaoAmareloDireitoUvbuffer, botaoAmareloDireitoNormalbuffer, botaoAmareloDireitoElementbuffer);
-	deleteBuffers(botaoVermelhoMeioVertexbuffer, botaoVermelhoMeioUvbuffer, botaoVermelhoMeioNormalbuffer, botaoVermelhoMeioElementbuffer);
-	deleteBuffers(mesaVertexbuffer, mesaUvbuffer, mesaNormalbuffer, mesaElementbuffer);
-	deleteBuffers(restoJogoVertexbuffer, restoJogoUvbuffer, restoJogoNormalbuffer, restoJogoElementbuffer);
-	deleteBuffers(meioRestoJogoVertexbuffer, meioRestoJogoUvbuffer, meioRestoJogoNormalbuffer, meioRestoJogoElementbuffer);
-
-	glDeleteProgram(programID);
-
-	glDeleteTextures(1, &mesaTexture);
-	glDeleteTextures(1, &botaoAmareloTexture);
-	glDeleteTextures(1, &botaoAzulTexture);
-	glDeleteTextures(1, &botaoVerdeTexture);
-	glDeleteTextures(1, &botaoVermelhoTexture);
-	glDeleteTextures(1, &botaoAmareloDireitoTexture);
-	glDeleteTextures(1, &botaoVermelhoMeioTexture);
-	glDeleteTextures(1, &botaoAmareloEsquerdoTexture);
-	glDeleteTextures(1, &meioRestoJogoTexture);
- 	glDeleteTextures(1, &restoJogoTexture);
+	deleteMeshArena(meshArena);
+	deleteStaticBatch(staticBatch);
+	deleteCullingScene(cullingScene);
+	// A shared mesh is deleted with its last reference
+	for (int i = 0; i < meshCount; i++)
+		if (!meshLoads[i].merge && (!meshLoads[i].identified || releaseMesh(resourceCache, meshLoads[i].key)))
+			deleteMesh(*meshLoads[i].mesh);
+	for (int i = 0; i < textureCount; i++)
+		if (textureLoads[i].identified)
+			releaseTexture(resourceCache, textureLoads[i].key);
+
+	deleteShading(shading);
+
+	deleteTextureArray(textureArray);
 
 	// Close GUI and OpenGL window, and terminate GLFW
 	TwTerminate();
+	if (headless) {
+		deleteOffscreenTarget(offscreenTarget);
+		deleteOffscreenContext(offscreen);
+	}
 	glfwTerminate();
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file